@@ -0,0 +1,65 @@
+#include "AudioBenchmark.h"
+#include "AudioChannel.h"
+
+void AudioBenchmark::run(AudioChannel **channels, uint8_t channelCount, Print &out) {
+    out.println(F("Audio benchmark"));
+    for (int i = 0; i < channelCount; i++) {
+        // the full load, whatever the governor lowered
+        channels[i]->setQuality(QUALITY_FULL);
+        channels[i]->setMaxParams();
+    }
+    // let the sounds that are still playing end
+    delay(AUDIO_BENCHMARK_MILLIS);
+    measure(channels, channelCount, false);
+    uint32_t idle = average;
+    measure(channels, channelCount, true);
+    // the same for the sounds of the benchmark, so they are not heard once the outputs are unmuted
+    delay(AUDIO_BENCHMARK_MILLIS);
+
+    float blockMicros = AUDIO_BLOCK_SAMPLES * 1000000.0f / AUDIO_SAMPLE_RATE_EXACT;
+    out.print(AUDIO_BLOCK_SAMPLES);
+    out.print(F(" samples per block: "));
+    out.print(blockMicros, 0);
+    out.print(F(" us per block, trigger to dac up to "));
+    out.print(blockMicros * AUDIO_BENCHMARK_LATENCY_BLOCKS, 0);
+    out.println(F(" us"));
+    out.print(F("idle update: "));
+    printUpdate(out, idle);
+    out.println();
+    out.print(F("busy update: "));
+    printUpdate(out, average);
+    out.print(F(", max "));
+    printUpdate(out, maximum);
+    out.println();
+}
+
+void AudioBenchmark::measure(AudioChannel **channels, uint8_t channelCount, bool playing) {
+    uint64_t sum = 0;
+    uint32_t samples = 0;
+    AudioProcessorUsageMaxReset();
+    uint32_t start = millis();
+    uint32_t lastTrigger = start - AUDIO_BENCHMARK_TRIGGER_MILLIS;
+    while (millis() - start < AUDIO_BENCHMARK_MILLIS) {
+        if (playing && millis() - lastTrigger >= AUDIO_BENCHMARK_TRIGGER_MILLIS) {
+            lastTrigger = millis();
+            for (int i = 0; i < channelCount; i++) {
+                channels[i]->trigger();
+            }
+        }
+        // polled all the time, every update counts as often as the others (they are evenly spaced)
+        sum += AudioStream::cpu_cycles_total;
+        samples++;
+    }
+    // the audio library counts in units of 16 cycles
+    average = sum * 16 / samples;
+    maximum = AudioStream::cpu_cycles_total_max * 16;
+}
+
+void AudioBenchmark::printUpdate(Print &out, uint32_t cycles) {
+    out.print(cycles);
+    out.print(F(" cycles ("));
+    out.print(cycles * 100.0f / (F_CPU / AUDIO_SAMPLE_RATE_EXACT * AUDIO_BLOCK_SAMPLES), 1);
+    out.print(F("% of a block, "));
+    out.print((float)cycles / AUDIO_BLOCK_SAMPLES, 1);
+    out.print(F(" per sample)"));
+}
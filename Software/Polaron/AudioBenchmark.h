@@ -0,0 +1,41 @@
+#ifndef AudioBenchmark_h
+#define AudioBenchmark_h
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+// how long the idle and the busy updates are measured, and the time between two triggers while busy
+#define AUDIO_BENCHMARK_MILLIS 2000
+#define AUDIO_BENCHMARK_TRIGGER_MILLIS 25
+// a trigger waits for the next update (up to one block), then the dac buffers two blocks
+#define AUDIO_BENCHMARK_LATENCY_BLOCKS 3
+
+class AudioChannel;
+
+/*
+ * Measures the cost of the audio updates against the latency of the block size the firmware is built with.
+ * The block size is AUDIO_BLOCK_SAMPLES (128 by default) and needs to be the same for the core and the audio library,
+ * so it is set as a compiler flag for the whole build (e.g. -DAUDIO_BLOCK_SAMPLES=32 in platform.local.txt).
+ * 16, 32, 64 and 128 samples are supported.
+ * Smaller blocks shorten the time from a trigger to the dac, but the fixed cost of an update (the interrupt, calling
+ * every audio object, passing the blocks) is paid more often. The idle update (nothing playing) is that fixed cost,
+ * the busy update plays all tracks with the longest decays and the most retriggers.
+ * Run it on each block size and compare the reports.
+ */
+class AudioBenchmark {
+   public:
+    AudioBenchmark(){};
+    // blocks for a few seconds and prints the result. the channels are set to full quality, the governor needs to be
+    // reset. the sequencer needs to be stopped. the channels are left at their max params.
+    void run(AudioChannel **channels, uint8_t channelCount, Print &out);
+
+   private:
+    // measures the average and max cycles of an update
+    void measure(AudioChannel **channels, uint8_t channelCount, bool playing);
+    void printUpdate(Print &out, uint32_t cycles);
+
+    uint32_t average = 0;
+    uint32_t maximum = 0;
+};
+
+#endif
@@ -22,10 +22,26 @@
 
 #include "AudioStream.h"
 #include "ParameterSet.h"
+#include "AudioProfiler.h"
 
 #ifndef AudioChannel_h
 #define AudioChannel_h
 
+// quality levels of the channels, the load is reduced step by step (see AudioGovernor). each level includes the
+// reductions of the levels before it.
+#define QUALITY_FULL 0
+// fewer partials (hats)
+#define QUALITY_FEWER_PARTIALS 1
+// filters with fewer stages (hats, bap)
+#define QUALITY_CHEAP_FILTERS 2
+// envelopes decay within QUALITY_SHORT_DECAY_MILLIS
+#define QUALITY_SHORT_TAILS 3
+// envelopes are not retriggered
+#define QUALITY_NO_RETRIGGERS 4
+#define QUALITY_LEVELS 5
+#define QUALITY_SHORT_DECAY_MILLIS 200
+#define QUALITY_SHORT_DECAY (QUALITY_SHORT_DECAY_MILLIS * 441 / 10)
+
 class AudioChannel {
    public:
 
@@ -41,10 +57,41 @@ class AudioChannel {
     virtual void setParam4(int value);
     virtual void setParam5(int value);
     virtual void setParam6(int value);
+    // sets all six params at once
+    void setParams(const ParameterSet &params) {
+        setParam1(params.parameter1);
+        setParam2(params.parameter2);
+        setParam3(params.parameter3);
+        setParam4(params.parameter4);
+        setParam5(params.parameter5);
+        setParam6(params.parameter6);
+    }
+    // the max of all params has the longest decays and the most retriggers (the load of the audio benchmark and the
+    // audio memory calibration)
+    void setMaxParams() { setParams(ParameterSet(1023, 1023, 1023, 1023, 1023, 1023)); }
+    // reduces the load of the channel to the given level (QUALITY_...), QUALITY_FULL restores everything
+    virtual void setQuality(uint8_t level) {}
+    // adds the audio objects of the channel to the profiler (as group track)
+    virtual void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, getOutput1(), "output1");
+        if (getOutput2() != getOutput1()) {
+            profiler.add(track, getOutput2(), "output2");
+        }
+    }
     void setVolume(int volumeArg) { volume = volumeArg / 128.0f; }
     void setPan(int panArg) { pan = panArg / 1024.0f; }
     float getOutput1Gain() { return volume * (1.0 - pan); }
     float getOutput2Gain() { return volume * pan; }
+    // sets volume / pan so that they result in the given gains (inverse of getOutput1Gain / getOutput2Gain)
+    void setOutputGains(float output1Gain, float output2Gain) {
+        volume = output1Gain + output2Gain;
+        pan = volume > 0.0f ? output2Gain / volume : 0.5f;
+    }
+
+   protected:
+    // limits of the envelopes for a quality level (see AudioEffectShapedEnvelope::limit)
+    static uint16_t getDecayLimit(uint8_t level) { return level >= QUALITY_SHORT_TAILS ? QUALITY_SHORT_DECAY : 65535; }
+    static uint16_t getRetriggerLimit(uint8_t level) { return level >= QUALITY_NO_RETRIGGERS ? 0 : 65535; }
 
    private:
     float volume = 2.0f;
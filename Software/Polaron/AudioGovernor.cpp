@@ -0,0 +1,36 @@
+#include "AudioGovernor.h"
+
+void AudioGovernor::begin(AudioChannel **channels, uint8_t channelCount, uint16_t memoryBlocks) {
+    this->channels = channels;
+    this->channelCount = channelCount;
+    this->memoryBlocks = memoryBlocks;
+    lastChange = millis();
+    lastLoad = lastChange;
+}
+
+void AudioGovernor::update() {
+    uint32_t percent = CYCLE_COUNTER_APPROX_PERCENT(AudioStream::cpu_cycles_total);
+    uint16_t used = AudioMemoryUsage();
+    uint16_t freeBlocks = used < memoryBlocks ? memoryBlocks - used : 0;
+    uint32_t now = millis();
+    if (percent >= highPercent || freeBlocks < AUDIO_GOVERNOR_MIN_FREE_BLOCKS) {
+        lastLoad = now;
+        if (quality < QUALITY_LEVELS - 1 && now - lastChange >= AUDIO_GOVERNOR_STEP_MILLIS) {
+            setQuality(quality + 1);
+        }
+    } else if (percent >= lowPercent || freeBlocks < 2 * AUDIO_GOVERNOR_MIN_FREE_BLOCKS) {
+        lastLoad = now;
+    } else if (quality > QUALITY_FULL && now - lastLoad >= AUDIO_GOVERNOR_RECOVER_MILLIS &&
+               now - lastChange >= AUDIO_GOVERNOR_RECOVER_MILLIS) {
+        // one level per interval, the load of the next level is checked before going further
+        setQuality(quality - 1);
+    }
+}
+
+void AudioGovernor::setQuality(uint8_t level) {
+    quality = level;
+    lastChange = millis();
+    for (int i = 0; i < channelCount; i++) {
+        channels[i]->setQuality(level);
+    }
+}
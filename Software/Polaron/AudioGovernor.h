@@ -0,0 +1,59 @@
+#ifndef AudioGovernor_h
+#define AudioGovernor_h
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "AudioChannel.h"
+#include "AudioPool.h"
+
+// cpu usage of an audio update (in percent of the time of one block) from which the quality is lowered
+#define AUDIO_GOVERNOR_HIGH_PERCENT 80
+// the quality is raised again after the usage stayed below this for AUDIO_GOVERNOR_RECOVER_MILLIS
+#define AUDIO_GOVERNOR_LOW_PERCENT 55
+// free audio blocks below which the quality is lowered (blocks are allocated by the playing sounds). given for blocks
+// of 128 samples like the pool sizes, smaller blocks need more of them for the same audio.
+#define AUDIO_GOVERNOR_MIN_FREE_BLOCKS (8 * AUDIO_POOL_BLOCKS_PER_128_SAMPLES)
+// min time between two steps down, so the lower level can take effect first
+#define AUDIO_GOVERNOR_STEP_MILLIS 30
+#define AUDIO_GOVERNOR_RECOVER_MILLIS 2000
+
+/*
+ * Lowers the quality of all channels one level at a time (see QUALITY_... in AudioChannel.h) while the audio updates
+ * come close to their time budget or the audio memory runs low, before there is a dropout. The quality is restored
+ * level by level once the load is low again.
+ * The usage is sampled from the last audio update on every loop, so the loop needs to run faster than the audio
+ * updates (every 2.9ms with 128 samples per block, 0.36ms with 16) to catch every one of them.
+ */
+class AudioGovernor {
+   public:
+    AudioGovernor(){};
+    // memoryBlocks: the number of blocks allocated with AudioMemory()
+    void begin(AudioChannel **channels, uint8_t channelCount, uint16_t memoryBlocks);
+    void setThresholds(uint8_t highPercent, uint8_t lowPercent) {
+        this->highPercent = highPercent;
+        this->lowPercent = lowPercent;
+    }
+    // needs to be called once per loop
+    void update();
+    // goes back to full quality, e.g. before a measurement
+    void reset() {
+        setQuality(QUALITY_FULL);
+        lastLoad = lastChange;
+    }
+    uint8_t getQuality() { return quality; }
+
+   private:
+    void setQuality(uint8_t level);
+
+    AudioChannel **channels = NULL;
+    uint8_t channelCount = 0;
+    uint16_t memoryBlocks = 0;
+    uint8_t highPercent = AUDIO_GOVERNOR_HIGH_PERCENT;
+    uint8_t lowPercent = AUDIO_GOVERNOR_LOW_PERCENT;
+    uint8_t quality = QUALITY_FULL;
+    uint32_t lastChange = 0;
+    // last time the load was not low
+    uint32_t lastLoad = 0;
+};
+
+#endif
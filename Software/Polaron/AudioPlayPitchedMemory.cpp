@@ -22,7 +22,10 @@
 
 #include "AudioPlayPitchedMemory.h"
 #include "spi_interrupt.h"
+#include "AudioPool.h"
 
+// two samples are written per step of the sample index
+static_assert(AUDIO_BLOCK_SAMPLES % 2 == 0, "the sample player needs an even number of samples per block");
 
 void AudioPlayPitchedMemory::begin(void)
 {
@@ -65,7 +68,10 @@ void AudioPlayPitchedMemory::update(void)
     
     // allocate the audio blocks to transmit
     block = allocate();
-    if (block == NULL) return;
+    if (block == NULL) {
+        AudioPool::countFailure();
+        return;
+    }
     
     out = block->data;
 
@@ -0,0 +1,134 @@
+#include "AudioPool.h"
+#include <EEPROM.h>
+#include "AudioChannel.h"
+
+volatile uint32_t AudioPool::allocationFailures = 0;
+
+static DMAMEM audio_block_t poolBlocks[AUDIO_POOL_RESERVED_BLOCKS];
+
+void AudioPool::begin() {
+    calibrated = readCalibration();
+    size = AUDIO_POOL_RESERVED_BLOCKS;
+    // what AudioMemory() does
+    AudioStream::initialize_memory(poolBlocks, size);
+}
+
+void AudioPool::update() {
+    bool exhausted = AudioMemoryUsage() >= size;
+    if (exhausted && !wasExhausted) {
+        exhaustions++;
+    }
+    wasExhausted = exhausted;
+    if (isCalibrating()) {
+        updateCalibration();
+    }
+}
+
+void AudioPool::startCalibration(AudioChannel **channels, uint8_t channelCount) {
+    Serial.println(F("Calibrating audio memory"));
+    calibrationChannels = channels;
+    calibrationChannelCount = channelCount;
+    calibrationRun = 0;
+    calibrationPlaying = false;
+    calibrationPhaseStart = millis();
+    calibrationPeak = 0;
+}
+
+void AudioPool::updateCalibration() {
+    uint32_t now = millis();
+    TrackMask tracks = getCalibrationTracks();
+    if (!calibrationPlaying) {
+        // let the sounds of the previous run end
+        if (now - calibrationPhaseStart < AUDIO_POOL_CALIBRATION_MILLIS) {
+            return;
+        }
+        for (int i = 0; i < calibrationChannelCount; i++) {
+            if (tracks & trackBit(i)) {
+                calibrationChannels[i]->setQuality(QUALITY_FULL);
+                calibrationChannels[i]->setMaxParams();
+            }
+        }
+        AudioMemoryUsageMaxReset();
+        calibrationPlaying = true;
+        calibrationPhaseStart = now;
+        lastCalibrationTrigger = now - AUDIO_POOL_CALIBRATION_TRIGGER_MILLIS;
+    }
+    if (now - calibrationPhaseStart < AUDIO_POOL_CALIBRATION_MILLIS) {
+        if (now - lastCalibrationTrigger >= AUDIO_POOL_CALIBRATION_TRIGGER_MILLIS) {
+            lastCalibrationTrigger = now;
+            for (int i = 0; i < calibrationChannelCount; i++) {
+                if (tracks & trackBit(i)) {
+                    calibrationChannels[i]->trigger();
+                }
+            }
+        }
+        return;
+    }
+    // the run is done, its high water mark is the usage of the tracks
+    uint16_t blocks = AudioMemoryUsageMax();
+    if (calibrationRun < calibrationChannelCount) {
+        calibration.trackBlocks[calibrationRun] = blocks;
+    }
+    calibrationPeak = max(calibrationPeak, blocks);
+    calibrationPlaying = false;
+    calibrationPhaseStart = now;
+    calibrationRun++;
+    if (calibrationRun > calibrationChannelCount) {
+        finishCalibration();
+    }
+}
+
+void AudioPool::finishCalibration() {
+    calibrationChannels = NULL;
+    uint16_t peak = calibrationPeak;
+    if (peak >= size) {
+        Serial.println(F("Audio memory ran out while calibrating"));
+    }
+    uint16_t blocks = peak + AUDIO_POOL_MARGIN_BLOCKS + peak * AUDIO_POOL_MARGIN_PERCENT / 100;
+    calibration.magic = AUDIO_POOL_MAGIC;
+    calibration.blockSamples = AUDIO_BLOCK_SAMPLES;
+    calibration.blocks = constrain(blocks, AUDIO_POOL_MIN_BLOCKS, AUDIO_POOL_MAX_BLOCKS);
+    EEPROM.put(AUDIO_POOL_EEPROM_ADDRESS, calibration);
+    calibrated = true;
+    printReport(Serial);
+}
+
+bool AudioPool::readCalibration() {
+    EEPROM.get(AUDIO_POOL_EEPROM_ADDRESS, calibration);
+    return calibration.magic == AUDIO_POOL_MAGIC && calibration.blockSamples == AUDIO_BLOCK_SAMPLES &&
+           calibration.blocks >= AUDIO_POOL_MIN_BLOCKS && calibration.blocks <= AUDIO_POOL_MAX_BLOCKS;
+}
+
+void AudioPool::printReport(Print &out) {
+    out.print(F("Audio pool: "));
+    out.print(size);
+    out.print(F(" blocks of "));
+    out.print(AUDIO_BLOCK_SAMPLES);
+    out.print(F(" samples, used max "));
+    out.print(AudioMemoryUsageMax());
+    out.print(F(", ran out "));
+    out.print(exhaustions);
+    out.print(F(" times, failed allocations "));
+    out.println(allocationFailures);
+    if (!calibrated) {
+        out.println(F("not calibrated"));
+        return;
+    }
+    out.print(F("calibrated: "));
+    out.print(calibration.blocks);
+    out.print(F(" blocks, tracks alone:"));
+    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+        out.print(F(" "));
+        out.print(calibration.trackBlocks[i]);
+    }
+    out.println();
+    if (calibration.blocks > AUDIO_POOL_BLOCKS) {
+        out.print(F("the build reserves too few blocks, "));
+    } else if (calibration.blocks < AUDIO_POOL_BLOCKS) {
+        out.print(F("the build reserves unused blocks, "));
+    } else {
+        return;
+    }
+    out.print(F("build with #define AUDIO_POOL_BLOCKS "));
+    out.println(calibration.blocks);
+}
@@ -0,0 +1,101 @@
+#ifndef AudioPool_h
+#define AudioPool_h
+
+#include <Arduino.h>
+#include <AudioStream.h>
+#include "SequencerConfig.h"
+
+// the sizes are given for blocks of 128 samples (260 bytes). smaller blocks are shorter, more of them are needed for
+// the same audio (mostly for the delay), so the same amount of memory is used.
+#define AUDIO_POOL_BLOCKS_PER_128_SAMPLES (128 / AUDIO_BLOCK_SAMPLES)
+// the size of the pool, the calibration report prints the value to put here
+#define AUDIO_POOL_BLOCKS (70 * AUDIO_POOL_BLOCKS_PER_128_SAMPLES)
+// uncomment for a calibration build: it reserves the max size and calibrates the pool at every power up
+// #define AUDIO_POOL_CALIBRATION
+// the pool of a calibration build, a calibrated size is never larger
+#define AUDIO_POOL_MAX_BLOCKS (160 * AUDIO_POOL_BLOCKS_PER_128_SAMPLES)
+#define AUDIO_POOL_MIN_BLOCKS (24 * AUDIO_POOL_BLOCKS_PER_128_SAMPLES)
+#ifdef AUDIO_POOL_CALIBRATION
+#define AUDIO_POOL_RESERVED_BLOCKS AUDIO_POOL_MAX_BLOCKS
+#else
+#define AUDIO_POOL_RESERVED_BLOCKS AUDIO_POOL_BLOCKS
+#endif
+static_assert(AUDIO_POOL_BLOCKS >= AUDIO_POOL_MIN_BLOCKS && AUDIO_POOL_BLOCKS <= AUDIO_POOL_MAX_BLOCKS,
+              "AUDIO_POOL_BLOCKS out of range");
+// added to the calibrated high water mark: a fixed number of blocks plus a share (in percent)
+#define AUDIO_POOL_MARGIN_BLOCKS 6
+#define AUDIO_POOL_MARGIN_PERCENT 20
+// location of the calibration in the eeprom
+#define AUDIO_POOL_EEPROM_ADDRESS 0
+#define AUDIO_POOL_MAGIC 0x4151
+// calibration: how long each track plays alone and all tracks together, and the time between two triggers
+#define AUDIO_POOL_CALIBRATION_MILLIS 2000
+#define AUDIO_POOL_CALIBRATION_TRIGGER_MILLIS 25
+
+class AudioChannel;
+
+/*
+ * The memory for the audio blocks. Its size is calibrated by a calibration build (AUDIO_POOL_CALIBRATION), which plays
+ * all tracks with the parameters that hold on to blocks the longest (long decays, many retriggers), first each track
+ * alone, then all of them together. The high water mark plus a margin is stored in the eeprom and reported as the
+ * AUDIO_POOL_BLOCKS to build the firmware with. The blocks are taken from a static array of AUDIO_POOL_BLOCKS, like
+ * AudioMemory() does. The calibration stays a guide for the build, the firmware always uses the whole array.
+ * The calibration is played from update(), one run after another, so it does not hold up the startup.
+ * At runtime, the times the pool ran empty are counted (sampled once per loop), as well as the blocks our own
+ * audio objects could not allocate (the objects of the audio library drop them silently).
+ */
+class AudioPool {
+   public:
+    AudioPool(){};
+    // hands the pool to the audio library (the max size in a calibration build)
+    void begin();
+    // checks for an empty pool and continues a calibration, needs to be called once per loop
+    void update();
+    // starts playing the stress pattern (about half a minute), the result is stored and printed when it is done.
+    // the sequencer must not use the channels until then.
+    void startCalibration(AudioChannel **channels, uint8_t channelCount);
+    bool isCalibrating() { return calibrationChannels != NULL; }
+    void printReport(Print &out);
+    uint16_t getSize() { return size; }
+    // called by the audio objects (from the audio interrupt) if allocate() returned NULL
+    static void countFailure() { allocationFailures++; }
+
+   private:
+    class Calibration {
+       public:
+        uint16_t magic;
+        uint16_t blocks;
+        // the calibration is only valid for the block size it was made with
+        uint16_t blockSamples;
+        // high water mark of each track when playing alone
+        uint16_t trackBlocks[NUMBER_OF_INSTRUMENTTRACKS];
+    };
+
+    // plays the current run of the calibration (a pause, then the tracks of the run are triggered)
+    void updateCalibration();
+    void finishCalibration();
+    // the tracks of the current run: each track alone, the last run all of them
+    TrackMask getCalibrationTracks() {
+        return calibrationRun < calibrationChannelCount ? trackBit(calibrationRun) : ~(TrackMask)0;
+    }
+    bool readCalibration();
+
+    static volatile uint32_t allocationFailures;
+    Calibration calibration;
+    bool calibrated = false;
+    uint16_t size = 0;
+    // the running calibration, NULL if there is none
+    AudioChannel **calibrationChannels = NULL;
+    uint8_t calibrationChannelCount = 0;
+    uint8_t calibrationRun = 0;
+    // false during the pause before the run
+    bool calibrationPlaying = false;
+    uint32_t calibrationPhaseStart = 0;
+    uint32_t lastCalibrationTrigger = 0;
+    uint16_t calibrationPeak = 0;
+    // times the pool was found empty
+    uint32_t exhaustions = 0;
+    bool wasExhausted = false;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "AudioProfiler.h"
+
+bool AudioProfiler::add(uint8_t group, AudioStream *stream, const char *name) {
+    if (nodeCount >= AUDIO_PROFILE_MAX_NODES || group >= AUDIO_PROFILE_GROUPS) {
+        droppedNodes++;
+        return false;
+    }
+    Node &node = nodes[nodeCount++];
+    node.stream = stream;
+    node.name = name;
+    node.group = group;
+    node.cycleSum = 0;
+    return true;
+}
+
+void AudioProfiler::update() {
+    uint32_t now = micros();
+    if (now - lastSample < AUDIO_PROFILE_SAMPLE_MICROS) {
+        return;
+    }
+    lastSample = now;
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].cycleSum += nodes[i].stream->cpu_cycles;
+    }
+    samples++;
+}
+
+void AudioProfiler::printReport(Print &out) {
+    uint32_t cycles[AUDIO_PROFILE_GROUPS];
+    uint32_t maxCycles[AUDIO_PROFILE_GROUPS];
+    uint32_t avgCycles[AUDIO_PROFILE_GROUPS];
+    uint8_t counts[AUDIO_PROFILE_GROUPS];
+    sumGroups(cycles, maxCycles, avgCycles, counts);
+    out.println(F("CPU % (current, max, avg)"));
+    // no average for the total, it is only measured per audio block
+    out.print(F("all="));
+    out.print(toHundredths(AudioStream::cpu_cycles_total) / 100.0f);
+    out.print(F(","));
+    out.print(toHundredths(AudioStream::cpu_cycles_total_max) / 100.0f);
+    out.println();
+    if (droppedNodes > 0) {
+        out.print(F("not profiled: "));
+        out.print(droppedNodes);
+        out.println(F(" objects"));
+    }
+    for (int group = 0; group < AUDIO_PROFILE_GROUPS; group++) {
+        if (counts[group] == 0) {
+            continue;
+        }
+        if (group == AUDIO_PROFILE_OUTPUT_GROUP) {
+            out.print(F("output"));
+        } else {
+            out.print(F("track "));
+            out.print(group + 1);
+        }
+        out.print(F(": "));
+        printUsage(out, cycles[group], maxCycles[group], avgCycles[group]);
+        out.println();
+        for (int i = 0; i < nodeCount; i++) {
+            Node &node = nodes[i];
+            if (node.group != group) {
+                continue;
+            }
+            out.print(F("    "));
+            out.print(node.name);
+            out.print(F(": "));
+            printUsage(out, node.stream->cpu_cycles, node.stream->cpu_cycles_max, getAverage(node));
+            out.println();
+        }
+    }
+    out.print(F("Memory (blocks): "));
+    out.print(AudioMemoryUsage());
+    out.print(F(","));
+    out.print(AudioMemoryUsageMax());
+    out.println();
+    startAverage();
+}
+
+void AudioProfiler::sendSysEx() {
+    uint32_t cycles[AUDIO_PROFILE_GROUPS];
+    uint32_t maxCycles[AUDIO_PROFILE_GROUPS];
+    uint32_t avgCycles[AUDIO_PROFILE_GROUPS];
+    uint8_t counts[AUDIO_PROFILE_GROUPS];
+    sumGroups(cycles, maxCycles, avgCycles, counts);
+    uint8_t message[AUDIO_PROFILE_SYSEX_MAX_LENGTH];
+    uint8_t length = 0;
+    message[length++] = 0xF0;
+    message[length++] = AUDIO_PROFILE_SYSEX_ID;
+    message[length++] = AUDIO_PROFILE_SYSEX_TYPE;
+    for (int group = 0; group < AUDIO_PROFILE_GROUPS; group++) {
+        if (counts[group] == 0) {
+            continue;
+        }
+        uint16_t values[3] = {toHundredths(cycles[group]), toHundredths(maxCycles[group]),
+                              toHundredths(avgCycles[group])};
+        message[length++] = group;
+        for (int i = 0; i < 3; i++) {
+            message[length++] = values[i] & 0x7F;
+            message[length++] = (values[i] >> 7) & 0x7F;
+        }
+    }
+    uint16_t memory[2] = {(uint16_t)AudioMemoryUsage(), (uint16_t)AudioMemoryUsageMax()};
+    for (int i = 0; i < 2; i++) {
+        message[length++] = memory[i] & 0x7F;
+        message[length++] = (memory[i] >> 7) & 0x7F;
+    }
+    message[length++] = 0xF7;
+    usbMIDI.sendSysEx(length, message, true);
+    startAverage();
+}
+
+void AudioProfiler::resetMax() {
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].stream->cpu_cycles_max = nodes[i].stream->cpu_cycles;
+    }
+    AudioProcessorUsageMaxReset();
+    AudioMemoryUsageMaxReset();
+}
+
+void AudioProfiler::startAverage() {
+    for (int i = 0; i < nodeCount; i++) {
+        nodes[i].cycleSum = 0;
+    }
+    samples = 0;
+}
+
+void AudioProfiler::sumGroups(uint32_t *cycles, uint32_t *maxCycles, uint32_t *avgCycles, uint8_t *counts) {
+    for (int group = 0; group < AUDIO_PROFILE_GROUPS; group++) {
+        cycles[group] = 0;
+        maxCycles[group] = 0;
+        avgCycles[group] = 0;
+        counts[group] = 0;
+    }
+    for (int i = 0; i < nodeCount; i++) {
+        Node &node = nodes[i];
+        cycles[node.group] += node.stream->cpu_cycles;
+        maxCycles[node.group] += node.stream->cpu_cycles_max;
+        avgCycles[node.group] += getAverage(node);
+        counts[node.group]++;
+    }
+}
+
+void AudioProfiler::printUsage(Print &out, uint32_t cycles, uint32_t maxCycles, uint32_t avgCycles) {
+    out.print(toHundredths(cycles) / 100.0f);
+    out.print(F(","));
+    out.print(toHundredths(maxCycles) / 100.0f);
+    out.print(F(","));
+    out.print(toHundredths(avgCycles) / 100.0f);
+}
+
+uint16_t AudioProfiler::toHundredths(uint32_t cycles) {
+    // the audio library counts cycles / 16 (see CYCLE_COUNTER_APPROX_PERCENT)
+    float hundredths = cycles * 10000.0f / (F_CPU / 16 / AUDIO_SAMPLE_RATE * AUDIO_BLOCK_SAMPLES);
+    // the max that fits into the 14 bits of the sysex message
+    return hundredths < 16383 ? (uint16_t)hundredths : 16383;
+}
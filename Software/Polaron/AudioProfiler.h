@@ -0,0 +1,66 @@
+#ifndef AudioProfiler_h
+#define AudioProfiler_h
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#define AUDIO_PROFILE_MAX_NODES 64
+#define AUDIO_PROFILE_GROUPS 16
+// group of the nodes that belong to no track (mixers, output)
+#define AUDIO_PROFILE_OUTPUT_GROUP (AUDIO_PROFILE_GROUPS - 1)
+// the average is taken from one sample of each node per interval (one audio block, 2.9ms with 128 samples)
+#define AUDIO_PROFILE_SAMPLE_MICROS ((uint32_t)(AUDIO_BLOCK_SAMPLES * 1000000.0 / AUDIO_SAMPLE_RATE_EXACT))
+// manufacturer id for non-commercial use, followed by 'P' for the profile
+#define AUDIO_PROFILE_SYSEX_ID 0x7D
+#define AUDIO_PROFILE_SYSEX_TYPE 'P'
+// header, 7 bytes per group (group, current, max, average), 4 bytes memory (current, max), end
+#define AUDIO_PROFILE_SYSEX_MAX_LENGTH (3 + AUDIO_PROFILE_GROUPS * 7 + 4 + 1)
+
+/*
+ * Cpu usage of the audio objects, grouped by track. The audio library measures the cycles of each object's last
+ * update() (and its max), this adds an average over the time since the last report.
+ * The usage of a group is the sum of its objects (its max is the sum of their maxima, so an upper bound).
+ * Audio blocks are allocated from one shared pool and not attributed to the objects, memory is reported in total.
+ * All values are sent in 1/100 percent of the time of one audio block, 14 bits (2 bytes, lsb first).
+ */
+class AudioProfiler {
+   public:
+    AudioProfiler(){};
+    // adds an audio object. group is the track of its channel, AUDIO_PROFILE_OUTPUT_GROUP for all others.
+    // the name is not copied. returns false if the profile is full, the report shows how many objects are missing.
+    bool add(uint8_t group, AudioStream *stream, const char *name);
+    // samples the current usage of all objects, needs to be called once per loop
+    void update();
+    // prints the usage of each track and its objects, then starts a new average
+    void printReport(Print &out);
+    // sends the usage of each group (current, max, average) as one sysex message, then starts a new average
+    void sendSysEx();
+    // resets the max of all objects and the memory
+    void resetMax();
+
+   private:
+    class Node {
+       public:
+        AudioStream *stream;
+        const char *name;
+        uint8_t group;
+        uint32_t cycleSum;
+    };
+
+    void startAverage();
+    uint32_t getAverage(Node &node) { return samples > 0 ? node.cycleSum / samples : node.stream->cpu_cycles; }
+    // sums the usage of the objects of each group
+    void sumGroups(uint32_t *cycles, uint32_t *maxCycles, uint32_t *avgCycles, uint8_t *counts);
+    void printUsage(Print &out, uint32_t cycles, uint32_t maxCycles, uint32_t avgCycles);
+    // cycles (as counted by the audio library) in 1/100 percent of one audio block
+    uint16_t toHundredths(uint32_t cycles);
+
+    Node nodes[AUDIO_PROFILE_MAX_NODES];
+    uint8_t nodeCount = 0;
+    // objects that did not fit into the profile
+    uint8_t droppedNodes = 0;
+    uint32_t samples = 0;
+    uint32_t lastSample = 0;
+};
+
+#endif
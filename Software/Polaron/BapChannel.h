@@ -35,9 +35,14 @@ class BapChannel : public AudioChannel {
                    clickEnvToOsc1(clickEnv, osc1),
                    osc1ToMult(osc1, 0, mult, 0),
                    osc2ToMult(osc2, 0, mult, 1),
-                   noiseToFilter(noise, filter),
+                   noiseToFilterPath(noise, 0, filterPath, 0),
+                   noiseToCheapFilterPath(noise, 0, cheapFilterPath, 0),
+                   filterPathToFilter(filterPath, 0, filter, 0),
+                   cheapFilterPathToCheapFilter(cheapFilterPath, 0, cheapFilter, 0),
+                   filterToMix(filter, 0, filterMix, 0),
+                   cheapFilterToMix(cheapFilter, 0, filterMix, 1),
                    multToBodyEnv(mult, bodyEnv),
-                   filterToNoiseEnv(filter, noiseEnv),
+                   filterMixToNoiseEnv(filterMix, 0, noiseEnv, 0),
                    bodyEnvToMixer(bodyEnv, 0, mixer, 0),
                    noiseEnvToMixer(noiseEnv, 0, mixer, 1),
                    mixerToHighpass(mixer, highpass)
@@ -66,6 +71,10 @@ class BapChannel : public AudioChannel {
         mixer.gain(0, 0.5f);
         mixer.gain(1, 0.5f);
 
+        // only one of the filters gets the noise, the other one is not computed (no input)
+        filterPath.gain(1.0f);
+        cheapFilterPath.gain(0.0f);
+
         highpass.setHighpass(0, 100, 0.700);
         highpass.setHighpass(1, 150, 0.800);
         // setVolume(440);
@@ -87,21 +96,65 @@ class BapChannel : public AudioChannel {
     void setParam3(int value) { clickEnv.decay(value * 6); }
     void setParam4(int value) { bodyEnv.decay(value * 12); }
     void setParam5(int value) {
-        float mappedValue = 50.0 + value * 10.0; 
-        filter.setBandpass(0, mappedValue, 0.700);
-        filter.setBandpass(1, mappedValue, 0.700);
-        filter.setBandpass(2, mappedValue, 0.700);
-     }
+        filterFrequency = 50.0 + value * 10.0;
+        updateFilter();
+    }
     void setParam6(int value) { 
         noiseEnv.decay(value * 20); }
 
+    void setQuality(uint8_t level) {
+        cheapFilterOn = level >= QUALITY_CHEAP_FILTERS;
+        filterPath.gain(cheapFilterOn ? 0.0f : 1.0f);
+        cheapFilterPath.gain(cheapFilterOn ? 1.0f : 0.0f);
+        updateFilter();
+        bodyEnv.limit(getDecayLimit(level), getRetriggerLimit(level));
+        noiseEnv.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &osc1, "osc1");
+        profiler.add(track, &osc2, "osc2");
+        profiler.add(track, &mult, "mult");
+        profiler.add(track, &noise, "noise");
+        profiler.add(track, &filterPath, "filterPath");
+        profiler.add(track, &cheapFilterPath, "cheapFilterPath");
+        profiler.add(track, &filter, "filter");
+        profiler.add(track, &cheapFilter, "cheapFilter");
+        profiler.add(track, &filterMix, "filterMix");
+        profiler.add(track, &highpass, "highpass");
+        profiler.add(track, &bodyEnv, "bodyEnv");
+        profiler.add(track, &noiseEnv, "noiseEnv");
+        profiler.add(track, &dc, "dc");
+        profiler.add(track, &clickEnv, "clickEnv");
+        profiler.add(track, &mixer, "mixer");
+    }
+
    private:
+    // only the filter in use is updated, the other one when it is switched on
+    void updateFilter() {
+        if (cheapFilterOn) {
+            cheapFilter.setBandpass(0, filterFrequency, 0.700);
+        } else {
+            filter.setBandpass(0, filterFrequency, 0.700);
+            filter.setBandpass(1, filterFrequency, 0.700);
+            filter.setBandpass(2, filterFrequency, 0.700);
+        }
+    }
+
+    // the frequency of the default param5
+    float filterFrequency = 6550;
+    // one filter stage instead of three (QUALITY_CHEAP_FILTERS)
+    bool cheapFilterOn = false;
 
     AudioSynthWaveformModulated osc1;
     AudioSynthWaveformModulated osc2;
     AudioEffectMultiply mult;
     AudioSynthNoiseWhite noise;
+    AudioAmplifier filterPath;
+    AudioAmplifier cheapFilterPath;
     AudioFilterBiquad filter;
+    AudioFilterBiquad cheapFilter;
+    AudioMixer4 filterMix;
     AudioFilterBiquad highpass;
 
     
@@ -117,9 +170,14 @@ class BapChannel : public AudioChannel {
     AudioConnection clickEnvToOsc1;
     AudioConnection osc1ToMult;
     AudioConnection osc2ToMult;
-    AudioConnection noiseToFilter;
+    AudioConnection noiseToFilterPath;
+    AudioConnection noiseToCheapFilterPath;
+    AudioConnection filterPathToFilter;
+    AudioConnection cheapFilterPathToCheapFilter;
+    AudioConnection filterToMix;
+    AudioConnection cheapFilterToMix;
     AudioConnection multToBodyEnv;
-    AudioConnection filterToNoiseEnv;
+    AudioConnection filterMixToNoiseEnv;
     AudioConnection bodyEnvToMixer;
     AudioConnection noiseEnvToMixer;
     AudioConnection mixerToHighpass;
@@ -72,6 +72,19 @@ class BoomChannel : public AudioChannel {
     void setParam5(int value) { click.frequency(10.0f + value); }
     void setParam6(int value) { mixer.gain(1, value / 1024.0f); }
 
+    void setQuality(uint8_t level) {
+        ampEnv.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &dc, "dc");
+        profiler.add(track, &pitchEnv, "pitchEnv");
+        profiler.add(track, &osc, "osc");
+        profiler.add(track, &ampEnv, "ampEnv");
+        profiler.add(track, &click, "click");
+        profiler.add(track, &mixer, "mixer");
+    }
+
    private:
     AudioSynthWaveformDc dc;
     AudioEffectShapedEnvelope pitchEnv;
@@ -94,6 +94,22 @@ class BroadbandNoiseChannel : public AudioChannel {
         mixer.gain(2, 1.0 - g);
     }
 
+    void setQuality(uint8_t level) {
+        envelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &w1, "w1");
+        profiler.add(track, &w2, "w2");
+        profiler.add(track, &w3, "w3");
+        profiler.add(track, &mult1, "mult1");
+        profiler.add(track, &mult2, "mult2");
+        profiler.add(track, &noise, "noise");
+        profiler.add(track, &mixer, "mixer");
+        profiler.add(track, &filter, "filter");
+        profiler.add(track, &envelope, "envelope");
+    }
+
    private:
     AudioSynthWaveform w1;
     AudioSynthWaveform w2;
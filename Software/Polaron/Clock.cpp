@@ -13,6 +13,7 @@ void Clock::setStepLength(uint32_t newStepLength){
         stepLength = 1024000;
     }
     nextStepTime = lastStepTime + stepLength;
+    dirty = true;
 }
 
 void Clock::setClockMode(ClockMode newClockMode){
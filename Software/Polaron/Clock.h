@@ -30,7 +30,10 @@ enum class ClockMode { INTERNAL_CLOCK, MIDI_CLOCK, TRIGGER };
 class Clock {
    public:
 
-    void setSwing(float newSwing){swing = newSwing;};
+    void setSwing(float newSwing){
+        swing = newSwing;
+        dirty = true;
+    };
     float getSwing(){return swing;};
     
     void onStart();
@@ -47,6 +50,10 @@ class Clock {
     uint8_t getStepCount(){return stepCount;}
     ClockMode getClockMode(){return clockMode;}
 
+    // tempo / swing were changed since the project was last loaded or saved
+    bool isDirty(){return dirty;}
+    void clearDirty(){dirty = false;}
+
    private:
 
     bool shouldStepMidiClock();
@@ -67,6 +74,7 @@ class Clock {
     bool midiClockReceived = false;
     uint8_t previousTriggerSignal = 1;
     bool triggerReceived = false;
+    bool dirty = true;
 
 };
 
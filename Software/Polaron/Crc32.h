@@ -0,0 +1,10 @@
+#ifndef Crc32_h
+#define Crc32_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// standard crc-32 (as used by zip / png). pass the result of the previous call as crc to continue a checksum.
+uint32_t crc32(const void *data, size_t length, uint32_t crc = 0);
+
+#endif
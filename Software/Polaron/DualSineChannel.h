@@ -64,6 +64,19 @@ class DualSineChannel : public AudioChannel {
         mixer.gain(1, 1.0 - g);
     }
 
+    void setQuality(uint8_t level) {
+        envelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &osc1, "osc1");
+        profiler.add(track, &osc2, "osc2");
+        profiler.add(track, &mult, "mult");
+        profiler.add(track, &combine, "combine");
+        profiler.add(track, &mixer, "mixer");
+        profiler.add(track, &envelope, "envelope");
+    }
+
    private:
     int low = 35;
     int high = 880;
@@ -0,0 +1,229 @@
+#include "EditHistory.h"
+
+void EditHistory::clear() {
+    dropRedo();
+    while (undoCount > 0) {
+        dropOldest();
+    }
+    release(version);
+}
+
+void EditHistory::recordStep(SequencerTrack &track, PatternIndex pattern, uint8_t step, bool merge) {
+    EditRecord *record = add(track, EditType::STEP, pattern, step, merge);
+    if (record != NULL) {
+        capture(*record);
+    }
+}
+
+void EditHistory::recordPatternSettings(SequencerTrack &track, PatternIndex pattern, bool merge) {
+    EditRecord *record = add(track, EditType::PATTERN_SETTINGS, pattern, 0, merge);
+    if (record != NULL) {
+        capture(*record);
+    }
+}
+
+void EditHistory::recordPatternCopy(SequencerTrack &track, PatternIndex pattern) {
+    dropRedo();
+    // the spare blocks of the track limit the number of copies that can be undone
+    while (countCopies(track) >= EDIT_HISTORY_PATTERN_COPIES) {
+        dropOldest();
+    }
+    EditRecord *record = add(track, EditType::PATTERN_COPY, pattern, 0, false);
+    capture(*record);
+    record->settings.stepBlock = track.patterns[pattern].retainSteps();
+}
+
+void EditHistory::recordBaseParameter(SequencerTrack &track, uint8_t parameter) {
+    EditRecord *record = add(track, EditType::BASE_PARAMETER, 0, parameter, true);
+    if (record != NULL) {
+        capture(*record);
+    }
+}
+
+bool EditHistory::undo() {
+    if (undoCount == 0) {
+        return false;
+    }
+    if (!swap(at(undoCount - 1))) {
+        return false;
+    }
+    undoCount--;
+    redoCount++;
+    return true;
+}
+
+bool EditHistory::redo() {
+    if (redoCount == 0) {
+        return false;
+    }
+    if (!swap(at(undoCount))) {
+        return false;
+    }
+    undoCount++;
+    redoCount--;
+    return true;
+}
+
+bool EditHistory::swapVersion(SequencerTrack &track, PatternIndex pattern) {
+    if (version.type == EditType::NONE || version.track != &track || version.pattern != pattern) {
+        // a new pattern, its current state becomes the other version
+        release(version);
+        version.type = EditType::PATTERN_COPY;
+        version.track = &track;
+        version.pattern = pattern;
+        capture(version);
+        version.settings.stepBlock = track.patterns[pattern].retainSteps();
+        return false;
+    }
+    // switching the versions is an edit too (undone by switching again)
+    add(track, EditType::VERSION_SWAP, pattern, 0, false);
+    swap(version);
+    return true;
+}
+
+EditRecord *EditHistory::add(SequencerTrack &track, EditType type, PatternIndex pattern, uint8_t index, bool merge) {
+    if (merge) {
+        // the latest continuous edits, if the target was already recorded the record has its state from before
+        for (int n = undoCount - 1; n >= 0 && n >= undoCount - EDIT_HISTORY_MERGE_WINDOW; n--) {
+            EditRecord &record = at(n);
+            if (!record.mergeable || record.type != type) {
+                break;
+            }
+            if (record.track == &track && record.pattern == pattern && record.index == index) {
+                return NULL;
+            }
+        }
+    }
+    // a new edit replaces the edits that were undone
+    dropRedo();
+    if (undoCount == EDIT_HISTORY_SIZE) {
+        dropOldest();
+    }
+    EditRecord &record = at(undoCount++);
+    record.track = &track;
+    record.type = type;
+    record.pattern = pattern;
+    record.index = index;
+    record.mergeable = merge;
+    return &record;
+}
+
+uint8_t EditHistory::countCopies(SequencerTrack &track) {
+    uint8_t copies = 0;
+    for (int n = 0; n < undoCount; n++) {
+        if (at(n).type == EditType::PATTERN_COPY && at(n).track == &track) {
+            copies++;
+        }
+    }
+    return copies;
+}
+
+void EditHistory::dropRedo() {
+    for (int n = undoCount; n < undoCount + redoCount; n++) {
+        release(at(n));
+    }
+    redoCount = 0;
+}
+
+void EditHistory::dropOldest() {
+    release(at(0));
+    first = (first + 1) % EDIT_HISTORY_SIZE;
+    undoCount--;
+}
+
+void EditHistory::release(EditRecord &record) {
+    if (record.type == EditType::PATTERN_COPY) {
+        record.track->patterns[record.pattern].releaseSteps(record.settings.stepBlock);
+    }
+    record.type = EditType::NONE;
+}
+
+void EditHistory::capture(EditRecord &record) {
+    SequencerPattern &pattern = record.track->patterns[record.pattern];
+    switch (record.type) {
+        case EditType::STEP: {
+            SequencerStep step = SequencerStep(&pattern, record.index);
+            record.step.values = record.track->parameters.get(pattern.getSteps().locks[record.index]);
+            record.step.lockMask = step.getLockMask();
+            record.step.triggerMask = step.getTriggerMask();
+            record.step.triggerOn = step.isTriggerOn();
+            record.step.pLockOn = step.isParameterLockOn();
+            break;
+        }
+        case EditType::PATTERN_SETTINGS:
+        case EditType::PATTERN_COPY:
+            record.settings.triggerState = pattern.triggerState;
+            record.settings.pLockArmState = pattern.pLockArmState;
+            record.settings.trackLength = pattern.trackLength;
+            record.settings.offset = pattern.offset;
+            record.settings.autoMutate = pattern.autoMutate;
+            break;
+        case EditType::BASE_PARAMETER:
+            record.value = unpackParameter(record.track->parameters.base, record.index);
+            break;
+        default:
+            break;
+    }
+}
+
+bool EditHistory::restore(const EditRecord &record) {
+    SequencerPattern &pattern = record.track->patterns[record.pattern];
+    switch (record.type) {
+        case EditType::STEP: {
+            SequencerStep step = SequencerStep(&pattern, record.index);
+            // the only part that can fail, nothing is changed before it
+            if (!step.setLocks(record.step.lockMask, record.step.values)) {
+                return false;
+            }
+            if (record.step.triggerOn) {
+                step.setTriggerOn();
+            } else {
+                step.setTriggerOff();
+            }
+            if (record.step.pLockOn) {
+                step.setParameterLockRecordOn();
+            } else {
+                step.setParameterLockRecordOff();
+            }
+            step.setTriggerMask(record.step.triggerMask);
+            pattern.markDirty();
+            break;
+        }
+        case EditType::PATTERN_SETTINGS:
+        case EditType::PATTERN_COPY:
+            pattern.triggerState = record.settings.triggerState;
+            pattern.pLockArmState = record.settings.pLockArmState;
+            pattern.trackLength = record.settings.trackLength;
+            pattern.offset = record.settings.offset;
+            pattern.autoMutate = record.settings.autoMutate;
+            pattern.markDirty();
+            pattern.markEdited();
+            break;
+        case EditType::BASE_PARAMETER:
+            record.track->setBaseParameter(record.index, record.value);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
+
+bool EditHistory::swap(EditRecord &record) {
+    if (record.type == EditType::VERSION_SWAP) {
+        // the version may belong to another pattern by now
+        if (version.type != EditType::NONE && version.track == record.track && version.pattern == record.pattern) {
+            return swap(version);
+        }
+        return true;
+    }
+    EditRecord previous = record;
+    capture(record);
+    if (!restore(previous)) {
+        record = previous;
+        return false;
+    }
+    if (record.type == EditType::PATTERN_COPY) {
+        record.settings.stepBlock = record.track->patterns[record.pattern].swapSteps(previous.settings.stepBlock);
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#ifndef EditHistory_h
+#define EditHistory_h
+
+#include <inttypes.h>
+#include "SequencerTrack.h"
+
+// number of edits that can be undone
+#define EDIT_HISTORY_SIZE 64
+// pattern copies (per track) that can be undone, each keeps the overwritten step data in a spare block of the track.
+// one spare block is used by the a/b version.
+#define EDIT_HISTORY_PATTERN_COPIES (STEP_DATA_SPARE_BLOCKS - 1)
+// number of records that are searched for a record of the same target, when a continuous edit (pots) is recorded
+#define EDIT_HISTORY_MERGE_WINDOW 16
+
+enum class EditType : uint8_t { NONE, STEP, PATTERN_SETTINGS, PATTERN_COPY, BASE_PARAMETER, VERSION_SWAP };
+
+/*
+ * One edit in the history. The record keeps the state of the edited target from before the edit. Undo and redo swap
+ * it with the current state, so the same record works in both directions.
+ */
+class EditRecord {
+   public:
+    SequencerTrack *track;
+    EditType type = EditType::NONE;
+    PatternIndex pattern;
+    // the step (STEP) or the parameter (BASE_PARAMETER)
+    uint8_t index;
+    // the edit is continuous (pots), later edits of the same target are merged into this record
+    bool mergeable;
+    union {
+        struct {
+            PackedParameterSet values;
+            uint8_t lockMask;
+            uint8_t triggerMask;
+            bool triggerOn;
+            bool pLockOn;
+        } step;
+        struct {
+            StepMask triggerState;
+            StepMask pLockArmState;
+            StepIndex trackLength;
+            StepIndex offset;
+            bool autoMutate;
+            // the block of step data (PATTERN_COPY only)
+            StepBlockIndex stepBlock;
+        } settings;
+        uint16_t value;
+    };
+};
+
+/*
+ * Undo / redo of the edits of the patterns and the base parameters. The edits are kept in a ring of fixed size, the
+ * oldest edits are dropped when it is full. Recording an edit only stores the few bytes of its target, edits of the
+ * pots are merged into one record per target.
+ * Also keeps one other version of a pattern (a/b), the pattern can be switched between both versions at any time.
+ */
+class EditHistory {
+   public:
+    EditHistory(){};
+    // forgets all edits and the a/b version. needed before the tracks are replaced (loading a project).
+    void clear();
+    // the record functions have to be called before the target is changed
+    // step is the index in the pattern (not rotated). merge: the step is changed continuously (recording locks).
+    void recordStep(SequencerTrack &track, PatternIndex pattern, uint8_t step, bool merge);
+    // the triggers, plock states, length, rotation or auto mutate of the pattern
+    void recordPatternSettings(SequencerTrack &track, PatternIndex pattern, bool merge);
+    // the step data of the pattern is replaced (a copy of another pattern, a rotation applied to the steps)
+    void recordPatternCopy(SequencerTrack &track, PatternIndex pattern);
+    void recordBaseParameter(SequencerTrack &track, uint8_t parameter);
+    // returns false if there is nothing to undo / redo, or if the edit needs a parameter lock and the track has no free
+    // locks left (the edit stays in the history)
+    bool undo();
+    bool redo();
+    // switches the pattern to its other version. the first call for a pattern only stores the current state as the
+    // other version (and returns false).
+    bool swapVersion(SequencerTrack &track, PatternIndex pattern);
+
+   private:
+    EditRecord &at(uint8_t n) { return records[(first + n) % EDIT_HISTORY_SIZE]; }
+    // returns the new record, NULL if the edit was merged into an earlier record
+    EditRecord *add(SequencerTrack &track, EditType type, PatternIndex pattern, uint8_t index, bool merge);
+    // pattern copies of the track that can be undone
+    uint8_t countCopies(SequencerTrack &track);
+    void dropRedo();
+    void dropOldest();
+    void release(EditRecord &record);
+    void capture(EditRecord &record);
+    // returns false (and leaves the target unchanged) if the track has no free locks left
+    bool restore(const EditRecord &record);
+    bool swap(EditRecord &record);
+
+    EditRecord records[EDIT_HISTORY_SIZE];
+    // the other version of a pattern (type PATTERN_COPY), NONE if there is none
+    EditRecord version;
+    // ring position of the oldest record
+    uint8_t first = 0;
+    // records before the current position (can be undone) and after it (can be redone)
+    uint8_t undoCount = 0;
+    uint8_t redoCount = 0;
+};
+
+#endif
@@ -61,6 +61,18 @@ class FMChannel : public AudioChannel {
     void setParam5(int value) { envelope.retriggers(value >> 4); }
     void setParam6(int value) { fmEnvelope.decay(value * 16); }
 
+    void setQuality(uint8_t level) {
+        envelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+        fmEnvelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &modulatorOsc, "modulatorOsc");
+        profiler.add(track, &fmEnvelope, "fmEnvelope");
+        profiler.add(track, &carrierOsc, "carrierOsc");
+        profiler.add(track, &envelope, "envelope");
+    }
+
    private:
     int low = 35;
     int high = 880;
@@ -39,8 +39,13 @@ class HatsChannel : public AudioChannel {
           w6m(w6, 0, mixer, 5),
           w7m(w7, 0, mixer, 6),
           // w8m(w8, 0, mixer, 7),
-          mixerFilter(mixer, 0, filter, 0),
-          filterEnv(filter, 0, envelope, 0) {
+          mixerToFilterPath(mixer, 0, filterPath, 0),
+          mixerToCheapFilterPath(mixer, 0, cheapFilterPath, 0),
+          filterPathToFilter(filterPath, 0, filter, 0),
+          cheapFilterPathToCheapFilter(cheapFilterPath, 0, cheapFilter, 0),
+          filterToMix(filter, 0, filterMix, 0),
+          cheapFilterToMix(cheapFilter, 0, filterMix, 1),
+          filterMixToEnv(filterMix, 0, envelope, 0) {
         w1.amplitude(1.0f);
         w2.amplitude(1.0f);
         w3.amplitude(1.0f);
@@ -72,9 +77,10 @@ class HatsChannel : public AudioChannel {
         w7.begin(1.0, baseFreq * ratio6, WAVEFORM_SQUARE);
         // w8.begin(1.0, baseFreq * ratio7, WAVEFORM_SQUARE);
 
-        filter.setHighpass(0, 8000, 0.700);
-        filter.setHighpass(1, 8000, 0.700);
-        filter.setHighpass(2, 8000, 0.700);
+        // only one of the filters gets the signal, the other one is not computed (no input)
+        filterPath.gain(1.0f);
+        cheapFilterPath.gain(0.0f);
+        updateFilter();
         // filter.setLowpass(3, 15000, 0.500);
         // filter.setHighpass(3, 8000, 0.700 );
     }
@@ -98,17 +104,56 @@ class HatsChannel : public AudioChannel {
         // w8.frequency(baseFreq * ratio7);
     }
     void setParam2(int value) {
-        float mappedValue = (float)map(value, 0, 1024, 2000, 10000);
-        filter.setHighpass(0, mappedValue, 0.700);
-        filter.setHighpass(1, mappedValue, 0.700);
-        filter.setHighpass(2, mappedValue, 0.700);
+        filterFrequency = (float)map(value, 0, 1024, 2000, 10000);
+        updateFilter();
     }
     void setParam3(int value) { envelope.attack(value * 2);}
     void setParam4(int value) { envelope.decay(5 + value * 64); }
     void setParam5(int value) { ratioFactor1 = 0.5 + value / 1024.0f; }
     void setParam6(int value) { ratioFactor2 = 0.5 + value / 1024.0f; }
 
+    void setQuality(uint8_t level) {
+        // silent waveforms are not computed
+        float upperPartials = level >= QUALITY_FEWER_PARTIALS ? 0.0f : 1.0f;
+        w5.amplitude(upperPartials);
+        w6.amplitude(upperPartials);
+        w7.amplitude(upperPartials);
+        cheapFilterOn = level >= QUALITY_CHEAP_FILTERS;
+        filterPath.gain(cheapFilterOn ? 0.0f : 1.0f);
+        cheapFilterPath.gain(cheapFilterOn ? 1.0f : 0.0f);
+        updateFilter();
+        envelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &w1, "w1");
+        profiler.add(track, &w2, "w2");
+        profiler.add(track, &w3, "w3");
+        profiler.add(track, &w4, "w4");
+        profiler.add(track, &w5, "w5");
+        profiler.add(track, &w6, "w6");
+        profiler.add(track, &w7, "w7");
+        profiler.add(track, &mixer, "mixer");
+        profiler.add(track, &filterPath, "filterPath");
+        profiler.add(track, &cheapFilterPath, "cheapFilterPath");
+        profiler.add(track, &filter, "filter");
+        profiler.add(track, &cheapFilter, "cheapFilter");
+        profiler.add(track, &filterMix, "filterMix");
+        profiler.add(track, &envelope, "envelope");
+    }
+
    private:
+    // only the filter in use is updated, the other one when it is switched on
+    void updateFilter() {
+        if (cheapFilterOn) {
+            cheapFilter.setHighpass(0, filterFrequency, 0.700);
+        } else {
+            filter.setHighpass(0, filterFrequency, 0.700);
+            filter.setHighpass(1, filterFrequency, 0.700);
+            filter.setHighpass(2, filterFrequency, 0.700);
+        }
+    }
+
     float baseFreq = 40;
     float ratio1 = 2.0;
     float ratio2 = 3.0;
@@ -122,6 +167,9 @@ class HatsChannel : public AudioChannel {
     // Maybe with interpolation between slots? 
     float ratioFactor1 = 1.0;
     float ratioFactor2 = 1.0;
+    float filterFrequency = 8000;
+    // one filter stage instead of three (QUALITY_CHEAP_FILTERS)
+    bool cheapFilterOn = false;
     // float ratio7 = 10.0;
     // float ratio2 = 2.0;
 
@@ -133,7 +181,11 @@ class HatsChannel : public AudioChannel {
     AudioSynthWaveform w6;
     AudioSynthWaveform w7;
     AudioMixer8 mixer;
+    AudioAmplifier filterPath;
+    AudioAmplifier cheapFilterPath;
     AudioFilterBiquad filter;
+    AudioFilterBiquad cheapFilter;
+    AudioMixer4 filterMix;
     AudioEffectShapedEnvelope envelope;
 
     AudioConnection w1m;
@@ -143,7 +195,12 @@ class HatsChannel : public AudioChannel {
     AudioConnection w5m;
     AudioConnection w6m;
     AudioConnection w7m;
-    AudioConnection mixerFilter;
-    AudioConnection filterEnv;
+    AudioConnection mixerToFilterPath;
+    AudioConnection mixerToCheapFilterPath;
+    AudioConnection filterPathToFilter;
+    AudioConnection cheapFilterPathToCheapFilter;
+    AudioConnection filterToMix;
+    AudioConnection cheapFilterToMix;
+    AudioConnection filterMixToEnv;
 };
 #endif
@@ -0,0 +1,221 @@
+#include "JsonStreamParser.h"
+#include "Arduino.h"
+
+void JsonStreamParser::begin(File &f, JsonStreamListener &l) {
+    file = &f;
+    listener = &l;
+    state = JsonParseState::PARSING;
+    bufferLength = 0;
+    bufferPosition = 0;
+    pushedBack = -1;
+    depth = 0;
+    expectKey = false;
+    expectValue = true;
+}
+
+JsonParseState JsonStreamParser::resume(uint32_t timeBudgetMicros) {
+    uint32_t start = micros();
+    while (state == JsonParseState::PARSING) {
+        if (timeBudgetMicros > 0 && micros() - start >= timeBudgetMicros) {
+            break;
+        }
+        state = parseNextToken();
+        if (state == JsonParseState::PARSING && listener->isStopped()) {
+            state = JsonParseState::FAILED;
+        }
+    }
+    return state;
+}
+
+// parses the next token and reports it to the listener
+JsonParseState JsonStreamParser::parseNextToken() {
+    JsonStreamListener &listener = *this->listener;
+    int c = nextNonWhitespace();
+    if (c < 0) {
+        // unexpected end of file
+        return JsonParseState::FAILED;
+    }
+    bool valueDone = false;
+    if (expectKey) {
+        if (c == '"') {
+            if (!readString(path[depth - 1].key, JSON_STREAM_MAX_KEY_LENGTH) || nextNonWhitespace() != ':') {
+                return JsonParseState::FAILED;
+            }
+            expectKey = false;
+            expectValue = true;
+            return JsonParseState::PARSING;
+        }
+        // empty object
+        if (c != '}') {
+            return JsonParseState::FAILED;
+        }
+    } else if (expectValue) {
+        if (c == '{' || c == '[') {
+            if (depth >= JSON_STREAM_MAX_DEPTH) {
+                return JsonParseState::FAILED;
+            }
+            listener.onStart(*this);
+            Level &level = path[depth++];
+            level.isArray = c == '[';
+            level.index = 0;
+            level.key[0] = 0;
+            expectKey = !level.isArray;
+            expectValue = level.isArray;
+            return JsonParseState::PARSING;
+        }
+        int64_t value;
+        float floatValue;
+        if (c == '"') {
+            if (!readString(NULL, 0)) {
+                return JsonParseState::FAILED;
+            }
+            valueDone = true;
+        } else if (c == 't') {
+            if (!readLiteral("rue")) {
+                return JsonParseState::FAILED;
+            }
+            listener.onValue(*this, 1, 1.0f);
+            valueDone = true;
+        } else if (c == 'f') {
+            if (!readLiteral("alse")) {
+                return JsonParseState::FAILED;
+            }
+            listener.onValue(*this, 0, 0.0f);
+            valueDone = true;
+        } else if (c == 'n') {
+            if (!readLiteral("ull")) {
+                return JsonParseState::FAILED;
+            }
+            valueDone = true;
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            if (!readNumber(c, value, floatValue)) {
+                return JsonParseState::FAILED;
+            }
+            listener.onValue(*this, value, floatValue);
+            valueDone = true;
+        } else if (c != ']') {
+            // anything but the end of an empty array is an error
+            return JsonParseState::FAILED;
+        }
+    } else if (c == ',') {
+        Level &level = path[depth - 1];
+        if (level.isArray) {
+            level.index++;
+            expectValue = true;
+        } else {
+            expectKey = true;
+        }
+        return JsonParseState::PARSING;
+    }
+
+    if (!valueDone) {
+        // end of the current object / array
+        if (depth == 0 || path[depth - 1].isArray != (c == ']') || (c != ']' && c != '}')) {
+            return JsonParseState::FAILED;
+        }
+        depth--;
+        listener.onEnd(*this);
+    }
+    if (depth == 0) {
+        // the root value is complete, dont read any further
+        return JsonParseState::DONE;
+    }
+    expectKey = false;
+    expectValue = false;
+    return JsonParseState::PARSING;
+}
+
+bool JsonStreamParser::isKey(uint8_t level, const char *key) {
+    return level < depth && !path[level].isArray && strcmp(path[level].key, key) == 0;
+}
+
+int JsonStreamParser::next() {
+    if (pushedBack >= 0) {
+        int c = pushedBack;
+        pushedBack = -1;
+        return c;
+    }
+    if (bufferPosition >= bufferLength) {
+        int n = file->read(buffer, JSON_STREAM_BUFFER_SIZE);
+        if (n <= 0) {
+            return -1;
+        }
+        bufferLength = n;
+        bufferPosition = 0;
+    }
+    return (uint8_t)buffer[bufferPosition++];
+}
+
+int JsonStreamParser::nextNonWhitespace() {
+    int c;
+    do {
+        c = next();
+    } while (c == ' ' || c == '\n' || c == '\r' || c == '\t');
+    return c;
+}
+
+// reads the rest of a string (after the opening quote). the string is copied into target (if not NULL), truncated
+// to maxLength characters.
+bool JsonStreamParser::readString(char *target, uint8_t maxLength) {
+    uint8_t length = 0;
+    while (true) {
+        int c = next();
+        if (c < 0) {
+            return false;
+        }
+        if (c == '"') {
+            break;
+        }
+        if (c == '\\') {
+            // escape sequences are not decoded, only skipped
+            c = next();
+            if (c < 0) {
+                return false;
+            }
+        }
+        if (target != NULL && length < maxLength) {
+            target[length++] = c;
+        }
+    }
+    if (target != NULL) {
+        target[length] = 0;
+    }
+    return true;
+}
+
+bool JsonStreamParser::readLiteral(const char *rest) {
+    while (*rest) {
+        if (next() != *rest++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool JsonStreamParser::readNumber(int first, int64_t &value, float &floatValue) {
+    char token[24];
+    uint8_t length = 0;
+    bool isInteger = true;
+    int c = first;
+    while (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9')) {
+        if (length >= sizeof(token) - 1) {
+            return false;
+        }
+        if (c == '.' || c == 'e' || c == 'E') {
+            isInteger = false;
+        }
+        token[length++] = c;
+        c = next();
+    }
+    token[length] = 0;
+    // the character after the number belongs to the next token
+    pushedBack = c;
+    if (isInteger) {
+        value = token[0] == '-' ? strtoll(token, NULL, 10) : (int64_t)strtoull(token, NULL, 10);
+        floatValue = value;
+    } else {
+        floatValue = strtod(token, NULL);
+        value = floatValue;
+    }
+    return true;
+}
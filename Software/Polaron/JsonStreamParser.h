@@ -0,0 +1,87 @@
+#ifndef JsonStreamParser_h
+#define JsonStreamParser_h
+
+#include <SD.h>
+
+// max nesting of objects / arrays (a step parameter in a project file is at depth 8)
+#define JSON_STREAM_MAX_DEPTH 8
+// longer keys are truncated
+#define JSON_STREAM_MAX_KEY_LENGTH 15
+#define JSON_STREAM_BUFFER_SIZE 64
+
+class JsonStreamParser;
+
+enum class JsonParseState { PARSING, DONE, FAILED };
+
+/*
+ * Receives the events of a JsonStreamParser. The location of the event is available from the parser:
+ * getDepth() levels, each level is either an object key (isKey) or an array index (getIndex).
+ */
+class JsonStreamListener {
+   public:
+    // an object or array starts at the current location
+    virtual void onStart(JsonStreamParser &parser){};
+    // the object or array at the current location ended
+    virtual void onEnd(JsonStreamParser &parser){};
+    // a number or boolean (true=1, false=0) at the current location. strings and null are not reported.
+    // integers have 64 bits (step masks), unsigned values above the range of int64_t wrap around.
+    virtual void onValue(JsonStreamParser &parser, int64_t value, float floatValue) = 0;
+    // the listener can not take any more values, the parsing fails
+    virtual bool isStopped() { return false; }
+};
+
+/*
+ * A minimal, event driven json parser. Reads the file in small chunks and reports values to a listener as soon
+ * as they are parsed. No document is built, memory use is constant and does not depend on the size of the file.
+ */
+class JsonStreamParser {
+   public:
+    JsonStreamParser(){};
+    // parses one json value (normally the root object) from the current position of the file.
+    // returns false on syntax errors, if the nesting is too deep or if the listener stopped.
+    bool parse(File &file, JsonStreamListener &listener) {
+        begin(file, listener);
+        return resume(0) == JsonParseState::DONE;
+    }
+    // starts parsing without reading anything yet, the actual parsing is done by resume()
+    void begin(File &file, JsonStreamListener &listener);
+    // continues parsing until the value is complete or the time budget (in micros, 0 for no limit) is used up
+    JsonParseState resume(uint32_t timeBudgetMicros);
+
+    uint8_t getDepth() { return depth; }
+    bool isKey(uint8_t level, const char *key);
+    uint16_t getIndex(uint8_t level) { return path[level].index; }
+
+   private:
+    class Level {
+       public:
+        bool isArray;
+        uint16_t index;
+        char key[JSON_STREAM_MAX_KEY_LENGTH + 1];
+    };
+
+    JsonParseState parseNextToken();
+    int next();
+    int nextNonWhitespace();
+    bool readString(char *target, uint8_t maxLength);
+    bool readLiteral(const char *rest);
+    bool readNumber(int first, int64_t &value, float &floatValue);
+
+    File *file;
+    JsonStreamListener *listener;
+    JsonParseState state;
+    // inside an object, waiting for the next key
+    bool expectKey;
+    // waiting for a value
+    bool expectValue;
+    char buffer[JSON_STREAM_BUFFER_SIZE];
+    uint8_t bufferLength;
+    uint8_t bufferPosition;
+    // a character that was read ahead (end of a number), -1 if none
+    int pushedBack;
+
+    uint8_t depth;
+    Level path[JSON_STREAM_MAX_DEPTH];
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "LoopProfiler.h"
+#include "Sequencer.h"
+
+#ifdef LOOP_PROFILE
+LoopProfiler loopProfiler;
+#endif
+
+static const char *phaseNames[] = {"loop", "usb host", "midi input", "buttons", "update state", "step", "project swap",
+                                   "persistence", "led show"};
+// in the order of FunctionMode
+static const char *modeNames[] = {"start stop",    "set track length", "leave set track length", "toggle plocks",
+                                  "leave toggle plocks", "toggle mutes", "leave toggle mutes", "pattern ops",
+                                  "leave pattern ops", "set tempo", "default", "load project", "save project", "undo",
+                                  "redo", "swap pattern version"};
+
+static_assert(sizeof(phaseNames) / sizeof(phaseNames[0]) == (uint8_t)LoopPhase::FUNCTION_MODE, "a phase has no name");
+static_assert(sizeof(modeNames) / sizeof(modeNames[0]) == LOOP_PROFILE_MODES, "a function mode has no name");
+static_assert((uint8_t)FunctionMode::SWAP_PATTERN_VERSION + 1 == LOOP_PROFILE_MODES,
+              "LOOP_PROFILE_MODES does not match FunctionMode");
+
+void PhaseHistogram::add(uint32_t duration) {
+    counts[getBucket(duration)]++;
+    count++;
+    sum += duration;
+    if (duration > max) {
+        max = duration;
+    }
+}
+
+void PhaseHistogram::reset() {
+    for (int i = 0; i < LOOP_PROFILE_BUCKETS; i++) {
+        counts[i] = 0;
+    }
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+uint32_t PhaseHistogram::getPercentile(uint16_t perMille) {
+    // number of measurements that have to be covered (rounded up)
+    uint32_t needed = ((uint64_t)count * perMille + 999) / 1000;
+    uint32_t covered = 0;
+    for (int bucket = 0; bucket < LOOP_PROFILE_BUCKETS; bucket++) {
+        covered += counts[bucket];
+        if (covered >= needed && covered > 0) {
+            uint32_t end = getBucketEnd(bucket);
+            return end < max ? end : max;
+        }
+    }
+    return max;
+}
+
+uint8_t PhaseHistogram::getBucket(uint32_t duration) {
+    if (duration < 4) {
+        return duration;
+    }
+    uint8_t octave = 31 - __builtin_clz(duration);
+    if (octave >= LOOP_PROFILE_OCTAVES) {
+        return LOOP_PROFILE_BUCKETS - 1;
+    }
+    // the 2 bits below the highest one select the bucket in the octave
+    return 4 + (octave - 2) * 4 + ((duration >> (octave - 2)) & 3);
+}
+
+uint32_t PhaseHistogram::getBucketEnd(uint8_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    if (bucket == LOOP_PROFILE_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+    uint8_t shift = (bucket - 4) / 4;
+    return ((5 + (bucket - 4) % 4) << shift) - 1;
+}
+
+void LoopProfiler::begin() {
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+void LoopProfiler::printReport(Print &out) {
+    out.println(F("phase: count, avg, p50, p99, max (micros)"));
+    for (int phase = 0; phase < LOOP_PROFILE_PHASES; phase++) {
+        PhaseHistogram &histogram = histograms[phase];
+        if (histogram.getCount() == 0) {
+            continue;
+        }
+        out.print(getName(phase));
+        out.print(F(": "));
+        out.print(histogram.getCount());
+        out.print(F(", "));
+        out.print(histogram.getAverage());
+        out.print(F(", "));
+        out.print(histogram.getPercentile(500));
+        out.print(F(", "));
+        out.print(histogram.getPercentile(990));
+        out.print(F(", "));
+        out.print(histogram.getMax());
+        out.println();
+    }
+}
+
+void LoopProfiler::reset() {
+    for (int phase = 0; phase < LOOP_PROFILE_PHASES; phase++) {
+        histograms[phase].reset();
+    }
+}
+
+const char *LoopProfiler::getName(uint8_t phase) {
+    if (phase < (uint8_t)LoopPhase::FUNCTION_MODE) {
+        return phaseNames[phase];
+    }
+    return modeNames[phase - (uint8_t)LoopPhase::FUNCTION_MODE];
+}
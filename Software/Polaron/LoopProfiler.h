@@ -0,0 +1,95 @@
+#ifndef LoopProfiler_h
+#define LoopProfiler_h
+
+#include <Arduino.h>
+
+// measures how long the phases of the main loop take (printed by sending 'l' over the serial port, see Polaron.ino).
+// when commented out, the measurements are not compiled in at all.
+// #define LOOP_PROFILE
+
+// durations below 4 micros have their own bucket, above that each octave is split into 4 buckets.
+// the last bucket takes everything from 2^LOOP_PROFILE_OCTAVES micros (65ms) on.
+#define LOOP_PROFILE_OCTAVES 16
+#define LOOP_PROFILE_BUCKETS (4 + (LOOP_PROFILE_OCTAVES - 2) * 4 + 1)
+// number of FunctionMode values, each mode handler has its own histogram
+#define LOOP_PROFILE_MODES 16
+
+enum class LoopPhase : uint8_t {
+    // the whole loop
+    LOOP,
+    USB_HOST,
+    MIDI_INPUT,
+    BUTTONS,
+    UPDATE_STATE,
+    // parts of Sequencer::updateState()
+    STEP,
+    // a project loaded in the background replaces the current one
+    PROJECT_SWAP,
+    PERSISTENCE,
+    LED_SHOW,
+    // followed by the handlers of the function modes
+    FUNCTION_MODE
+};
+#define LOOP_PROFILE_PHASES ((uint8_t)LoopPhase::FUNCTION_MODE + LOOP_PROFILE_MODES)
+
+/*
+ * Distribution of the durations of one phase, in micros. The buckets get wider with the duration (about 25% of
+ * their value), percentiles are reported as the upper end of their bucket.
+ */
+class PhaseHistogram {
+   public:
+    void add(uint32_t duration);
+    void reset();
+    uint32_t getCount() { return count; }
+    uint32_t getMax() { return max; }
+    uint32_t getAverage() { return count > 0 ? sum / count : 0; }
+    // the duration that perMille of the measurements do not exceed
+    uint32_t getPercentile(uint16_t perMille);
+
+   private:
+    static uint8_t getBucket(uint32_t duration);
+    static uint32_t getBucketEnd(uint8_t bucket);
+
+    uint32_t counts[LOOP_PROFILE_BUCKETS] = {};
+    uint32_t count = 0;
+    uint64_t sum = 0;
+    uint32_t max = 0;
+};
+
+/*
+ * Histograms of the durations of the main loop phases, measured with the cycle counter. Use the macros below, they
+ * compile to nothing if LOOP_PROFILE is not defined. Phases can be nested (UPDATE_STATE contains STEP).
+ */
+class LoopProfiler {
+   public:
+    LoopProfiler(){};
+    // enables the cycle counter
+    void begin();
+    void start(uint8_t phase) { starts[phase] = ARM_DWT_CYCCNT; }
+    void stop(uint8_t phase) { histograms[phase].add((ARM_DWT_CYCCNT - starts[phase]) / (F_CPU / 1000000)); }
+    // prints count, average, p50, p99 and max of all phases that were measured
+    void printReport(Print &out);
+    void reset();
+
+   private:
+    const char *getName(uint8_t phase);
+
+    PhaseHistogram histograms[LOOP_PROFILE_PHASES];
+    uint32_t starts[LOOP_PROFILE_PHASES];
+};
+
+#ifdef LOOP_PROFILE
+extern LoopProfiler loopProfiler;
+#define LOOP_PROFILE_START(phase) loopProfiler.start((uint8_t)(phase))
+#define LOOP_PROFILE_STOP(phase) loopProfiler.stop((uint8_t)(phase))
+// the handler of a FunctionMode
+#define LOOP_PROFILE_START_MODE(mode) LOOP_PROFILE_START((uint8_t)LoopPhase::FUNCTION_MODE + (uint8_t)(mode))
+#define LOOP_PROFILE_STOP_MODE(mode) LOOP_PROFILE_STOP((uint8_t)LoopPhase::FUNCTION_MODE + (uint8_t)(mode))
+#else
+#define LOOP_PROFILE_START(phase)
+#define LOOP_PROFILE_STOP(phase)
+#define LOOP_PROFILE_START_MODE(mode)
+#define LOOP_PROFILE_STOP_MODE(mode)
+#endif
+
+#endif
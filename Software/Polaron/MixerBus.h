@@ -0,0 +1,50 @@
+#ifndef MixerBus_h
+#define MixerBus_h
+
+#include "mixer.h"
+#include "SequencerConfig.h"
+
+#define MIXER_INPUTS 8
+// number of mixers (per output) needed for all tracks
+#define MIXER_BUSES ((NUMBER_OF_INSTRUMENTTRACKS + MIXER_INPUTS - 1) / MIXER_INPUTS)
+
+static_assert(MIXER_BUSES <= MIXER_INPUTS, "too many buses for one master mixer");
+
+/*
+ * One output (left / right) of all tracks. Track n is input n % 8 of the mixer of bus n / 8. The bus mixers are summed
+ * by a master mixer (wired in the sketch), bus n is its input n.
+ * Changing the gain of a track only updates its own input. The gain and mute of a bus are the gain of its master input,
+ * so they are a single update and cost no extra pass over the samples.
+ */
+class MixerBus {
+   public:
+    // busMixers: one mixer per bus, master: sums the bus mixers
+    MixerBus(AudioMixer8 *busMixers, AudioMixer8 &master) : mixers(busMixers), master(master) {
+        for (uint8_t i = 0; i < MIXER_BUSES; i++) {
+            busGains[i] = 1.0f;
+            busMuted[i] = false;
+        }
+    }
+    void setTrackGain(uint8_t track, float gain) {
+        mixers[track / MIXER_INPUTS].gain(track % MIXER_INPUTS, gain);
+    }
+    void setBusGain(uint8_t bus, float gain) {
+        busGains[bus] = gain;
+        updateBus(bus);
+    }
+    void setBusMute(uint8_t bus, bool mute) {
+        busMuted[bus] = mute;
+        updateBus(bus);
+    }
+    bool isBusMuted(uint8_t bus) { return busMuted[bus]; }
+
+   private:
+    void updateBus(uint8_t bus) { master.gain(bus, busMuted[bus] ? 0.0f : busGains[bus]); }
+
+    AudioMixer8 *mixers;
+    AudioMixer8 &master;
+    float busGains[MIXER_BUSES];
+    bool busMuted[MIXER_BUSES];
+};
+
+#endif
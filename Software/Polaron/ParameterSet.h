@@ -23,6 +23,12 @@
 #ifndef ParameterSet_h
 #define ParameterSet_h
 
+#include <inttypes.h>
+
+// parameters are 10bit values (0..1023, the range of the pots)
+#define PARAMETER_BITS 10
+#define PARAMETER_MAX 1023
+
 class ParameterSet {
    public:
     ParameterSet(){
@@ -46,4 +52,50 @@ class ParameterSet {
     uint16_t parameter6;
 };
 
+// the six parameters of a ParameterSet packed into one 64bit word, 10 bits each (parameter1 in the lowest bits).
+// steps store their parameters this way, a set is copied / compared as a single value.
+typedef uint64_t PackedParameterSet;
+
+inline uint16_t clampParameter(uint16_t value) { return value > PARAMETER_MAX ? PARAMETER_MAX : value; }
+
+// returns parameter 0..5 of a packed set
+inline uint16_t unpackParameter(PackedParameterSet packed, uint8_t parameter) {
+    return (packed >> (parameter * PARAMETER_BITS)) & PARAMETER_MAX;
+}
+
+// returns a mask with all bits of the parameters in parameterMask set (bit n of parameterMask for parameter n)
+inline PackedParameterSet parameterFieldMask(uint8_t parameterMask) {
+    PackedParameterSet fields = 0;
+    for (uint8_t p = 0; p < 6; p++) {
+        if (parameterMask & (1 << p)) {
+            fields |= (PackedParameterSet)PARAMETER_MAX << (p * PARAMETER_BITS);
+        }
+    }
+    return fields;
+}
+
+// returns the packed set with parameter 0..5 replaced by value
+inline PackedParameterSet setPackedParameter(PackedParameterSet packed, uint8_t parameter, uint16_t value) {
+    uint8_t shift = parameter * PARAMETER_BITS;
+    return (packed & ~((PackedParameterSet)PARAMETER_MAX << shift)) | ((PackedParameterSet)clampParameter(value) << shift);
+}
+
+inline PackedParameterSet packParameters(const ParameterSet &params) {
+    // the lower 30 bits (parameter 1-3) and the rest are built separately, the cpu has no 64bit shifts
+    uint32_t low = clampParameter(params.parameter1) | (clampParameter(params.parameter2) << 10) |
+                   ((uint32_t)clampParameter(params.parameter3) << 20);
+    uint32_t high = clampParameter(params.parameter4) | (clampParameter(params.parameter5) << 10) |
+                    ((uint32_t)clampParameter(params.parameter6) << 20);
+    return low | ((PackedParameterSet)high << 30);
+}
+
+// decodes all six parameters at once (used when a step triggers)
+inline ParameterSet unpackParameters(PackedParameterSet packed) {
+    uint32_t low = packed;
+    uint32_t high = packed >> 32;
+    return ParameterSet(low & PARAMETER_MAX, (low >> 10) & PARAMETER_MAX, (low >> 20) & PARAMETER_MAX,
+                        ((low >> 30) | (high << 2)) & PARAMETER_MAX, (high >> 8) & PARAMETER_MAX,
+                        (high >> 18) & PARAMETER_MAX);
+}
+
 #endif
\ No newline at end of file
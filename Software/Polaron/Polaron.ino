@@ -26,7 +26,13 @@
 #include "Bounce2.h"
 #include "FastLED.h"
 #include "Sequencer.h"
-#include "mixer.h"
+#include "MixerBus.h"
+#include "LoopProfiler.h"
+#include "Trace.h"
+#include "AudioGovernor.h"
+#include "AudioPool.h"
+#include "AudioBenchmark.h"
+#include "ProjectBenchmark.h"
 #include <Audio.h>
 
 #include "ParameterSet.h"
@@ -46,6 +52,21 @@
 // in order to use this feature you need a special cable: https://www.pjrc.com/store/cable_usb_host_t36.html
 // #define ENABLE_USBHOST
 
+// shows a led chase after power up. the animation runs in the main loop, the sequencer can be used right away
+// (a button press ends it). comment out for a completely dark start.
+#define STARTUP_ANIMATION
+#define STARTUP_ANIMATION_FRAME_MILLIS 20
+
+// cpu usage of the tracks / audio objects, printed by sending 'a' over the serial port ('r' resets the max).
+// 'l' prints the durations of the main loop phases (if LOOP_PROFILE is defined, see LoopProfiler.h, 'r' resets them too).
+// 't' / 'T' dump the event trace to the serial port / the sd card (if TRACE is defined, see Trace.h).
+// 'p' loads a legacy project with a parameter lock in every step and checks the locks (see ProjectBenchmark.h).
+// 's' toggles a sysex message with the usage of the tracks, sent every AUDIO_PROFILE_SYSEX_MILLIS (see AudioProfiler.h)
+#define AUDIO_PROFILE_SYSEX_MILLIS 1000
+
+// how long the buttons are read at startup to detect diagnostic mode (needs to be longer than the debounce interval)
+#define DIAGNOSTIC_PROBE_MILLIS 25
+
 #define PULSE_WIDTH_USEC 5
 
 #define SHIFT_IN_PLOAD_PIN 0  // 2  // Connects to Parallel load pin the 165
@@ -59,6 +80,11 @@ USBHost usbHost;
 MIDIDevice usbHostMIDI(usbHost);
 #endif
 
+#ifdef TRACE
+// created before all other audio objects, so it is updated first
+TraceMarker audioStartMarker(TraceEvent::AUDIO_START);
+#endif
+
 BoomChannel channel1;
 //SimpleSampleChannel channel2;
 SimpleDrumChannel channel2(200, 6000);
@@ -69,30 +95,88 @@ DualSineChannel channel4(16, 2000);
 BapChannel channel5;
 HatsChannel channel6;
 
-AudioMixer8 mixer1;
-AudioMixer8 mixer2;
+// the instruments of the first tracks (instruments without a track are not connected). builds with more tracks than
+// instruments play kicks on the additional tracks.
+#define NUMBER_OF_INSTRUMENTS 6
+AudioChannel *const instruments[] = {&channel1, &channel2, &channel3, &channel4, &channel5, &channel6};
+static_assert(sizeof(instruments) / sizeof(instruments[0]) == NUMBER_OF_INSTRUMENTS, "wrong number of instruments");
+#if NUMBER_OF_INSTRUMENTTRACKS > NUMBER_OF_INSTRUMENTS
+BoomChannel additionalChannels[NUMBER_OF_INSTRUMENTTRACKS - NUMBER_OF_INSTRUMENTS];
+#endif
+
+AudioChannel *getTrackChannel(uint8_t track) {
+    #if NUMBER_OF_INSTRUMENTTRACKS > NUMBER_OF_INSTRUMENTS
+    if (track >= NUMBER_OF_INSTRUMENTS) {
+        return &additionalChannels[track - NUMBER_OF_INSTRUMENTS];
+    }
+    #endif
+    return instruments[track];
+}
+
+// one mixer per bus and output, summed by a master mixer per output (see MixerBus.h). the master also mutes the buses.
+AudioMixer8 mixer1[MIXER_BUSES];
+AudioMixer8 mixer2[MIXER_BUSES];
+AudioMixer8 masterL;
+AudioMixer8 masterR;
+MixerBus busL(mixer1, masterL);
+MixerBus busR(mixer2, masterR);
 AudioOutputAnalogStereo dacs1;
+#ifdef TRACE
+TraceMarker audioEndMarker(TraceEvent::AUDIO_END);
+#endif
 
-AudioConnection patchCord8(*channel1.getOutput1(), 0, mixer1, 0);
-AudioConnection patchCord9(*channel2.getOutput1(), 0, mixer1, 1);
-AudioConnection patchCord10(*channel3.getOutput1(), 0, mixer1, 2);
-AudioConnection patchCord11(*channel4.getOutput1(), 0, mixer1, 3);
-AudioConnection patchCord12(*channel5.getOutput1(), 0, mixer1, 4);
-AudioConnection patchCord13(*channel6.getOutput1(), 0, mixer1, 5);
-AudioConnection patchCord14(*channel1.getOutput2(), 0, mixer2, 0);
-AudioConnection patchCord15(*channel2.getOutput2(), 0, mixer2, 1);
-AudioConnection patchCord16(*channel3.getOutput2(), 0, mixer2, 2);
-AudioConnection patchCord17(*channel4.getOutput2(), 0, mixer2, 3);
-AudioConnection patchCord18(*channel5.getOutput2(), 0, mixer2, 4);
-AudioConnection patchCord19(*channel6.getOutput2(), 0, mixer2, 5);
-
-AudioConnection patchCord20(mixer1, 0, dacs1, 0);
-AudioConnection patchCord21(mixer2, 0, dacs1, 1);
+// connects both outputs of a track to its inputs of the bus mixers. the cords of the tracks are created in track order
+// (trackCords below), so each one takes the next track.
+uint8_t nextCordsTrack = 0;
+class TrackCords {
+   public:
+    TrackCords()
+        : track(nextCordsTrack++),
+          output1(*getTrackChannel(track)->getOutput1(), 0, mixer1[track / MIXER_INPUTS], track % MIXER_INPUTS),
+          output2(*getTrackChannel(track)->getOutput2(), 0, mixer2[track / MIXER_INPUTS], track % MIXER_INPUTS) {}
+
+   private:
+    uint8_t track;
+    AudioConnection output1;
+    AudioConnection output2;
+};
+TrackCords trackCords[NUMBER_OF_INSTRUMENTTRACKS];
+
+// connects the mixers of a bus to their inputs of the master mixers, each one takes the next bus
+uint8_t nextCordsBus = 0;
+class BusCords {
+   public:
+    BusCords()
+        : bus(nextCordsBus++),
+          output1(mixer1[bus], 0, masterL, bus),
+          output2(mixer2[bus], 0, masterR, bus) {}
+
+   private:
+    uint8_t bus;
+    AudioConnection output1;
+    AudioConnection output2;
+};
+BusCords busCords[MIXER_BUSES];
+
+AudioConnection patchCord20(masterL, 0, dacs1, 0);
+AudioConnection patchCord21(masterR, 0, dacs1, 1);
 
 Sequencer sequencer;
+AudioProfiler audioProfiler;
+AudioGovernor audioGovernor;
+AudioPool audioPool;
+AudioBenchmark audioBenchmark;
+ProjectBenchmark projectBenchmark;
+bool audioProfileStreaming = false;
+uint32_t lastAudioProfileSent = 0;
 
 bool triggerInputFell = false;
 
+#ifdef STARTUP_ANIMATION
+bool startupAnimationRunning = true;
+uint32_t startupAnimationStart = 0;
+#endif
+
 void setup() {
     pinMode(SHIFT_IN_PLOAD_PIN, OUTPUT);
     pinMode(SHIFT_IN_CLOCK_PIN, OUTPUT);
@@ -114,48 +198,55 @@ void setup() {
     usbMIDI.setHandleRealTimeSystem(onRealTimeSystem);
 
 
-    AudioMemory(70);
+    #ifdef LOOP_PROFILE
+    loopProfiler.begin();
+    #endif
+    #ifdef TRACE
+    trace.begin();
+    #endif
     // dacs1.analogReference(EXTERNAL);
 
-    sequencer.audioChannels[0] = &channel1;
-    sequencer.audioChannels[1] = &channel2;
-    sequencer.audioChannels[2] = &channel3;
-    sequencer.audioChannels[3] = &channel4;
-    sequencer.audioChannels[4] = &channel5;
-    sequencer.audioChannels[5] = &channel6;
+    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++){
+        sequencer.audioChannels[i] = getTrackChannel(i);
+        sequencer.tracks[i].init(sequencer.audioChannels[i]->getDefaultParams());
+    }
 
+    sequencer.setMixers(&busL, &busR);
 
-    for (int i = 0; i < 6; i++){
-        sequencer.tracks[i].init(sequencer.audioChannels[i]->getDefaultParams());
+    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+        sequencer.audioChannels[i]->addToProfile(audioProfiler, i);
+    }
+    for (int i = 0; i < MIXER_BUSES; i++) {
+        audioProfiler.add(AUDIO_PROFILE_OUTPUT_GROUP, &mixer1[i], "mixer L");
+        audioProfiler.add(AUDIO_PROFILE_OUTPUT_GROUP, &mixer2[i], "mixer R");
     }
+    audioProfiler.add(AUDIO_PROFILE_OUTPUT_GROUP, &masterL, "master L");
+    audioProfiler.add(AUDIO_PROFILE_OUTPUT_GROUP, &masterR, "master R");
+    audioProfiler.add(AUDIO_PROFILE_OUTPUT_GROUP, &dacs1, "dacs");
 
-    sequencer.setMixers(&mixer1, &mixer2);
+    // continue where we left off before the power cycle
+    sequencer.persistence.restoreSession(&sequencer);
 
     FastLED.addLeds<WS2812B, DATA_PIN, GRB>(sequencer.leds, NUM_LEDS);
     FastLED.setBrightness(5);
 
-    for (int i = 0; i < NUM_LEDS; i++) {
-        for (int j = 0; j < NUM_LEDS; j++) {
-            sequencer.leds[j] = CRGB::Black;
-        }
-        sequencer.leds[i] = CRGB::Red;
-        FastLED.show();
-        delay(20);
-    }
-    for (int i = NUM_LEDS - 1; i >= 0; i--) {
-        for (int j = 0; j < NUM_LEDS; j++) {
-            sequencer.leds[j] = CRGB::Black;
-        }
-        sequencer.leds[i] = CRGB::Red;
-        FastLED.show();
-        delay(20);
-    }
-
     // detect diagnostic mode button press (-> debounce needs a few rounds..)
-    for (int i = 0; i < 10; i++){
+    uint32_t probeStart = millis();
+    while (millis() - probeStart < DIAGNOSTIC_PROBE_MILLIS){
         readButtonStates();
-        delay(10);
+        delay(1);
     }
+
+    // audio memory calibration: a build with AUDIO_POOL_CALIBRATION calibrates the size of the audio memory with a
+    // stress pattern at power up (played by the loop, all leds blue for about half a minute) and prints the size to
+    // build the firmware with (see AudioPool.h).
+    audioPool.begin();
+    audioGovernor.begin(sequencer.audioChannels, NUMBER_OF_INSTRUMENTTRACKS, audioPool.getSize());
+    #ifdef AUDIO_POOL_CALIBRATION
+    // the calibration measures the channels at full quality, the governor stays out of it
+    audioGovernor.reset();
+    audioPool.startCalibration(sequencer.audioChannels, NUMBER_OF_INSTRUMENTTRACKS);
+    #endif
     
     // diagnostic mode: lights up all LEDs. Pot 1+2 change the color of the LEDS. Pressing any Button will turn off the corresponding LED.
     if (sequencer.trackButtons[5].read()){
@@ -173,7 +264,7 @@ void setup() {
             }
             for (int i = 0; i < 6; i++) {
                 sequencer.leds[24+i] = sequencer.trackButtons[i].read() ? CRGB::Black : color;
-                if (sequencer.trackButtons[i].rose()){
+                if (i < NUMBER_OF_INSTRUMENTTRACKS && sequencer.trackButtons[i].rose()){
                     ParameterSet params = sequencer.audioChannels[i]->getDefaultParams();
                     sequencer.audioChannels[i]->setParam1(params.parameter1);
                     sequencer.audioChannels[i]->setParam2(params.parameter2);
@@ -194,8 +285,13 @@ void setup() {
     sequencer.leds[0] = CRGB::Black;
     FastLED.show();
 
+    // does not wait for the sd card, it is initialized in the background by the sequencer
     sequencer.persistence.init();
 
+    #ifdef STARTUP_ANIMATION
+    startupAnimationStart = millis();
+    #endif
+
     //while (!SD.begin(BUILTIN_SDCARD)) {
     //  Serial.println(F("Failed to initialize SD library"));
     //  delay(1000);
@@ -204,12 +300,32 @@ void setup() {
 
 inline void readButtonState(Bounce &button) {
     button.update();
+    #ifdef TRACE
+    if (button.rose() || button.fell()) {
+        TRACE_EVENT(BUTTON, getButtonId(button), button.rose());
+    }
+    #endif
     // Pulse the Clock (rising edge shifts the next bit).
     digitalWrite(SHIFT_IN_CLOCK_PIN, HIGH);
     // delayMicroseconds(PULSE_WIDTH_USEC);
     digitalWrite(SHIFT_IN_CLOCK_PIN, LOW);
 }
 
+#ifdef TRACE
+/*
+ * the number of the button in the trace (see TraceEvent::BUTTON)
+ */
+uint8_t getButtonId(Bounce &button) {
+    if (&button < sequencer.functionButtons + NUMBER_OF_FUNCTIONBUTTONS && &button >= sequencer.functionButtons) {
+        return &button - sequencer.functionButtons;
+    }
+    if (&button < sequencer.trackButtons + NUMBER_OF_TRACKBUTTONS && &button >= sequencer.trackButtons) {
+        return NUMBER_OF_FUNCTIONBUTTONS + (&button - sequencer.trackButtons);
+    }
+    return NUMBER_OF_FUNCTIONBUTTONS + NUMBER_OF_TRACKBUTTONS + (&button - sequencer.stepButtons);
+}
+#endif
+
 /*
  * updates all button states by reading in the values from the shift registers
  */
@@ -261,48 +377,182 @@ void readButtonStates() {
 }
 
 void loop() {
+    LOOP_PROFILE_START(LoopPhase::LOOP);
     FastLED.clearData();
     // read all inputs
     #ifdef ENABLE_USBHOST
+    LOOP_PROFILE_START(LoopPhase::USB_HOST);
     usbHost.Task();
     usbHostMIDI.read();
+    LOOP_PROFILE_STOP(LoopPhase::USB_HOST);
     #endif
+    LOOP_PROFILE_START(LoopPhase::MIDI_INPUT);
     usbMIDI.read();
+    LOOP_PROFILE_STOP(LoopPhase::MIDI_INPUT);
 
 
+    LOOP_PROFILE_START(LoopPhase::BUTTONS);
     readButtonStates();
+    LOOP_PROFILE_STOP(LoopPhase::BUTTONS);
     cli();
     if (triggerInputFell) {
       sequencer.onTriggerReceived();
       triggerInputFell = false;
     }
     sei();
-    // update the sequencer state
-    sequencer.updateState();
+    // update the sequencer state (the audio memory calibration plays the channels itself)
+    LOOP_PROFILE_START(LoopPhase::UPDATE_STATE);
+    if (!audioPool.isCalibrating()) {
+        sequencer.updateState();
+    }
+    LOOP_PROFILE_STOP(LoopPhase::UPDATE_STATE);
+    #ifdef STARTUP_ANIMATION
+    showStartupAnimation();
+    #endif
+    if (audioPool.isCalibrating()) {
+        for (int i = 0; i < NUM_LEDS; i++) {
+            sequencer.leds[i] = CRGB::Blue;
+        }
+    }
     // show the current state
+    LOOP_PROFILE_START(LoopPhase::LED_SHOW);
     FastLED.show();
+    LOOP_PROFILE_STOP(LoopPhase::LED_SHOW);
+    audioProfiler.update();
+    if (!audioPool.isCalibrating()) {
+        audioGovernor.update();
+    }
+    audioPool.update();
+    #ifdef TRACE
+    trace.update();
+    #endif
+    handleSerialCommands();
+    LOOP_PROFILE_STOP(LoopPhase::LOOP);
 }
 
+void setOutputsMuted(bool mute) {
+    for (uint8_t i = 0; i < MIXER_BUSES; i++) {
+        busL.setBusMute(i, mute);
+        busR.setBusMute(i, mute);
+    }
+}
+
+void handleSerialCommands() {
+    if (Serial.available() > 0) {
+        switch (Serial.read()) {
+            case 'a':
+                debugAudioUsage();
+                break;
+            case 'r':
+                audioProfiler.resetMax();
+                #ifdef LOOP_PROFILE
+                loopProfiler.reset();
+                #endif
+                break;
+            case 's':
+                audioProfileStreaming = !audioProfileStreaming;
+                break;
+            case 'b':
+                if (sequencer.isRunning()) {
+                    Serial.println(F("The sequencer needs to be stopped for the audio benchmark"));
+                } else if (audioPool.isCalibrating()) {
+                    Serial.println(F("The audio memory is being calibrated"));
+                } else {
+                    audioGovernor.reset();
+                    // the busy part plays every track at once, keep it off the outputs
+                    setOutputsMuted(true);
+                    audioBenchmark.run(sequencer.audioChannels, NUMBER_OF_INSTRUMENTTRACKS, Serial);
+                    // live triggers play the track params until the next step
+                    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+                        sequencer.audioChannels[i]->setParams(sequencer.tracks[i].getBaseParams());
+                    }
+                    setOutputsMuted(false);
+                }
+                break;
+            case 'p':
+                // the files are written and read in one go
+                if (sequencer.isRunning() || sequencer.persistence.isSaving()) {
+                    Serial.println(F("The sequencer needs to be stopped (and saved) for the project benchmark"));
+                } else if (!sequencer.persistence.isReady()) {
+                    Serial.println(F("The sd card is not ready"));
+                } else {
+                    projectBenchmark.run(&sequencer, Serial);
+                }
+                break;
+            #ifdef LOOP_PROFILE
+            case 'l':
+                loopProfiler.printReport(Serial);
+                break;
+            #endif
+            #ifdef TRACE
+            case 't':
+                // binary, to be read by the trace analyzer
+                trace.dump(Serial);
+                break;
+            case 'T':
+                // the file is written in one go, that would hold up the steps and a background save
+                if (sequencer.isRunning() || sequencer.persistence.isSaving()) {
+                    Serial.println(F("The sequencer needs to be stopped (and saved) to store the trace"));
+                } else if (sequencer.persistence.isReady() && trace.dumpToFile()) {
+                    Serial.println(F("Stored trace"));
+                }
+                break;
+            #endif
+        }
+    }
+    if (audioProfileStreaming && millis() - lastAudioProfileSent >= AUDIO_PROFILE_SYSEX_MILLIS) {
+        lastAudioProfileSent = millis();
+        audioProfiler.sendSysEx();
+    }
+}
+
+#ifdef STARTUP_ANIMATION
+/*
+ * draws the current frame of the startup led chase (one led running up and down) over the sequencer leds
+ */
+void showStartupAnimation() {
+    if (!startupAnimationRunning) {
+        return;
+    }
+    uint32_t frame = (millis() - startupAnimationStart) / STARTUP_ANIMATION_FRAME_MILLIS;
+    if (frame >= 2 * NUM_LEDS || anyButtonPressed()) {
+        startupAnimationRunning = false;
+        return;
+    }
+    for (int i = 0; i < NUM_LEDS; i++) {
+        sequencer.leds[i] = CRGB::Black;
+    }
+    sequencer.leds[frame < NUM_LEDS ? frame : 2 * NUM_LEDS - 1 - frame] = CRGB::Red;
+}
+
+bool anyButtonPressed() {
+    for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
+        if (sequencer.stepButtons[i].read()) return true;
+    }
+    for (int i = 0; i < NUMBER_OF_FUNCTIONBUTTONS; i++) {
+        if (sequencer.functionButtons[i].read()) return true;
+    }
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        if (sequencer.trackButtons[i].read()) return true;
+    }
+    return false;
+}
+#endif
+
 void onRealTimeSystem(uint8_t rtb) {
     sequencer.onMidiInput(rtb);
 }
 
 void onTriggerInputFell(){
+    TRACE_EVENT(TRIGGER_INPUT, 0, 0);
     cli();
     triggerInputFell = true;
     sei();
 }
 
 void debugAudioUsage() {
-    Serial.print("CPU: ");
-    Serial.print("all=");
-    Serial.print(AudioProcessorUsage());
-    Serial.print(",");
-    Serial.print(AudioProcessorUsageMax());
-    Serial.print("    ");
-    Serial.print("Memory: ");
-    Serial.print(AudioMemoryUsage());
-    Serial.print(",");
-    Serial.print(AudioMemoryUsageMax());
-    Serial.println();
+    audioProfiler.printReport(Serial);
+    audioPool.printReport(Serial);
+    Serial.print(F("Quality level: "));
+    Serial.println(audioGovernor.getQuality());
 }
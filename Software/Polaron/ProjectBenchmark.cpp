@@ -0,0 +1,89 @@
+#include "ProjectBenchmark.h"
+#include "Sequencer.h"
+#include "ProjectSnapshot.h"
+
+void ProjectBenchmark::run(Sequencer *sequencer, Print &out) {
+    out.println(F("Project benchmark"));
+    if (!writeFile(sequencer)) {
+        out.println(F("Failed to write the benchmark file"));
+        return;
+    }
+    uint32_t start = micros();
+    ProjectSnapshot *project = sequencer->persistence.parseFile(PROJECT_BENCHMARK_FILE, sequencer);
+    uint32_t time = micros() - start;
+    SD.remove(PROJECT_BENCHMARK_FILE);
+    if (project == NULL) {
+        out.println(F("Failed to load the legacy project"));
+        return;
+    }
+    uint16_t locks = 0;
+    uint16_t wrong = 0;
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
+        TrackParameters &parameters = project->tracks[t].parameters;
+        PackedParameterSet defaults = packParameters(sequencer->audioChannels[t]->getDefaultParams());
+        for (int p = 0; p < LEGACY_PATTERNS && p < NUMBER_OF_PATTERNS; p++) {
+            for (int s = 0; s < LEGACY_STEPS; s++) {
+                LockIndex lock = project->tracks[t].patterns[p].steps.locks[s];
+                if (parameters.getMask(lock) == 0b00111111 && parameters.get(lock) == getStepParams(defaults, p, s)) {
+                    locks++;
+                } else {
+                    wrong++;
+                }
+            }
+        }
+    }
+    out.print(F("legacy project with "));
+    out.print(locks);
+    out.print(F(" parameter locks loaded in "));
+    out.print(time / 1000);
+    out.println(F(" ms"));
+    if (wrong > 0) {
+        out.print(wrong);
+        out.println(F(" steps have wrong parameters"));
+    }
+}
+
+bool ProjectBenchmark::writeFile(Sequencer *sequencer) {
+    SD.remove(PROJECT_BENCHMARK_FILE);
+    File file = SD.open(PROJECT_BENCHMARK_FILE, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+    file.print("{\"global\":{\"stepLength\":125000,\"swing\":0},\"tracks\":[");
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
+        PackedParameterSet defaults = packParameters(sequencer->audioChannels[t]->getDefaultParams());
+        file.print(t == 0 ? "{" : ",{");
+        file.print("\"output1Gain\":0.5,\"output2Gain\":0.5,\"patterns\":[");
+        for (int p = 0; p < LEGACY_PATTERNS; p++) {
+            file.print(p == 0 ? "{" : ",{");
+            file.print("\"triggerState\":65535,\"pLockArmState\":0,\"offset\":0,\"trackLength\":16,\"autoMutate\":false,\"steps\":[");
+            for (int s = 0; s < LEGACY_STEPS; s++) {
+                file.print(s == 0 ? "{" : ",{");
+                file.print("\"triggerMask\":63,\"params\":[");
+                PackedParameterSet params = getStepParams(defaults, p, s);
+                for (int n = 0; n < NUMBER_OF_STEP_PARAMETERS; n++) {
+                    if (n > 0) {
+                        file.print(",");
+                    }
+                    file.print(unpackParameter(params, n));
+                }
+                file.print("]}");
+            }
+            file.print("]}");
+        }
+        file.print("]}");
+    }
+    file.print("]}");
+    file.close();
+    return true;
+}
+
+PackedParameterSet ProjectBenchmark::getStepParams(PackedParameterSet defaults, uint8_t pattern, uint8_t step) {
+    PackedParameterSet params = 0;
+    for (int n = 0; n < NUMBER_OF_STEP_PARAMETERS; n++) {
+        // 1..1023 away from the default, different for every step
+        uint16_t distance = 1 + ((pattern * LEGACY_STEPS + step) * 4 + n) % PARAMETER_MAX;
+        params = setPackedParameter(params, n, (unpackParameter(defaults, n) + distance) % (PARAMETER_MAX + 1));
+    }
+    return params;
+}
@@ -0,0 +1,31 @@
+#ifndef ProjectBenchmark_h
+#define ProjectBenchmark_h
+
+#include <Arduino.h>
+#include <SD.h>
+#include "ParameterSet.h"
+#include "ProjectLoader.h"
+
+#define PROJECT_BENCHMARK_FILE "/bench.txt"
+
+class Sequencer;
+
+/*
+ * Loads the worst case of a project file from before the track base parameters: every step of every pattern has
+ * parameters that differ from the defaults of its track, so each of them becomes a parameter lock. Writes the file,
+ * parses it like a load does (into the snapshot of the background save, the sequencer is not changed) and checks
+ * that every lock arrived. Prints the time the parsing took.
+ */
+class ProjectBenchmark {
+   public:
+    ProjectBenchmark(){};
+    // blocks while the file is written and read. the sd card needs to be ready, the sequencer stopped.
+    void run(Sequencer *sequencer, Print &out);
+
+   private:
+    bool writeFile(Sequencer *sequencer);
+    // the parameters of a step in the file, all of them differ from the defaults and from the other steps
+    PackedParameterSet getStepParams(PackedParameterSet defaults, uint8_t pattern, uint8_t step);
+};
+
+#endif
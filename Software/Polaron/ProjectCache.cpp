@@ -0,0 +1,85 @@
+#include "ProjectCache.h"
+
+ProjectCache::Entry *ProjectCache::find(int8_t project, uint32_t modification) {
+    for (int i = 0; i < PROJECT_CACHE_SLOTS; i++) {
+        Entry &entry = entries[i];
+        if (entry.complete && entry.project == project && entry.modification == modification) {
+            return &entry;
+        }
+    }
+    return NULL;
+}
+
+ProjectCache::Entry *ProjectCache::entryOf(ProjectSnapshot *snapshot) {
+    for (int i = 0; i < PROJECT_CACHE_SLOTS; i++) {
+        if (&entries[i].snapshot == snapshot) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+ProjectSnapshot *ProjectCache::get(int8_t project, uint32_t modification) {
+    Entry *entry = find(project, modification);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->lastUsed = ++useCounter;
+    return &entry->snapshot;
+}
+
+bool ProjectCache::contains(int8_t project, uint32_t modification) {
+    return find(project, modification) != NULL;
+}
+
+ProjectSnapshot *ProjectCache::allocate(int8_t project, uint32_t modification) {
+    Entry *target = NULL;
+    for (int i = 0; i < PROJECT_CACHE_SLOTS && target == NULL; i++) {
+        // an older version of the same project is replaced in any case
+        if (entries[i].project == project) {
+            target = &entries[i];
+        }
+    }
+    for (int i = 0; i < PROJECT_CACHE_SLOTS && target == NULL; i++) {
+        if (entries[i].project < 0) {
+            target = &entries[i];
+        }
+    }
+    if (target == NULL) {
+        target = &entries[0];
+        for (int i = 1; i < PROJECT_CACHE_SLOTS; i++) {
+            if (entries[i].lastUsed < target->lastUsed) {
+                target = &entries[i];
+            }
+        }
+    }
+    target->project = project;
+    target->modification = modification;
+    target->complete = false;
+    target->lastUsed = ++useCounter;
+    return &target->snapshot;
+}
+
+void ProjectCache::complete(ProjectSnapshot *snapshot) {
+    Entry *entry = entryOf(snapshot);
+    if (entry != NULL) {
+        entry->complete = true;
+    }
+}
+
+void ProjectCache::remove(ProjectSnapshot *snapshot) {
+    Entry *entry = entryOf(snapshot);
+    if (entry != NULL) {
+        entry->project = -1;
+        entry->complete = false;
+    }
+}
+
+bool ProjectCache::hasFreeEntry() {
+    for (int i = 0; i < PROJECT_CACHE_SLOTS; i++) {
+        if (entries[i].project < 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+#ifndef ProjectCache_h
+#define ProjectCache_h
+
+#include <inttypes.h>
+#include "ProjectSnapshot.h"
+
+// each cached project takes the size of a snapshot (see ProjectSnapshot.h), the lock pools of the tracks leave room
+// for two
+#define PROJECT_CACHE_SLOTS 2
+// ram the cache may take at most, so a change of the snapshot size does not go unnoticed
+#define PROJECT_CACHE_MAX_SIZE (72 * 1024)
+static_assert(PROJECT_CACHE_SLOTS * sizeof(ProjectSnapshot) <= PROJECT_CACHE_MAX_SIZE, "project cache takes too much ram");
+
+/*
+ * Keeps the most recently used projects in memory, so switching to one of them is a copy instead of reading and
+ * parsing the file. Entries are identified by the project slot and the modification counter of the project index,
+ * a project that was saved since it was cached is not returned any more.
+ */
+class ProjectCache {
+   public:
+    ProjectCache(){};
+    // returns the cached project, NULL if it is not cached (or outdated)
+    ProjectSnapshot *get(int8_t project, uint32_t modification);
+    bool contains(int8_t project, uint32_t modification);
+    // returns the entry to fill with a project, an unused or the least recently used entry is replaced.
+    // the entry is not returned by get() before it is completed.
+    ProjectSnapshot *allocate(int8_t project, uint32_t modification);
+    void complete(ProjectSnapshot *snapshot);
+    void remove(ProjectSnapshot *snapshot);
+    // returns true if there is an entry that is not used
+    bool hasFreeEntry();
+
+   private:
+    class Entry {
+       public:
+        int8_t project = -1;
+        bool complete = false;
+        uint32_t modification = 0;
+        uint32_t lastUsed = 0;
+        ProjectSnapshot snapshot;
+    };
+
+    Entry *find(int8_t project, uint32_t modification);
+    Entry *entryOf(ProjectSnapshot *snapshot);
+
+    Entry entries[PROJECT_CACHE_SLOTS];
+    uint32_t useCounter = 0;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "ProjectIndex.h"
+#include "Crc32.h"
+#include "Arduino.h"
+
+static const char *indexFilenames[2] = {"/p_idx0.bin", "/p_idx1.bin"};
+
+// open for in place updates (FILE_WRITE appends on some versions of the sd lib)
+#define FILE_UPDATE (O_RDWR | O_CREAT)
+
+// returns the slot of a project file name (p_<slot>.txt), -1 for any other file
+static int slotFromFilename(const char *name) {
+    if ((name[0] != 'p' && name[0] != 'P') || name[1] != '_' || name[2] < '0' || name[2] > '9') {
+        return -1;
+    }
+    char *end;
+    long slot = strtol(name + 2, &end, 10);
+    if (strcasecmp(end, ".txt") != 0 || slot >= PROJECTSLOTS) {
+        return -1;
+    }
+    return slot;
+}
+
+void ProjectIndex::beginLoad() {
+    loadStep = LoadStep::READ_COPY0;
+}
+
+bool ProjectIndex::loadNext() {
+    switch (loadStep) {
+        case LoadStep::READ_COPY0:
+            valid0 = read(0);
+            generation0 = header.generation;
+            loadStep = LoadStep::READ_COPY1;
+            break;
+        case LoadStep::READ_COPY1:
+            // use the copy with the higher generation, if both are valid
+            if (read(1) && (!valid0 || header.generation > generation0)) {
+                loadStep = LoadStep::DONE;
+            } else if (valid0) {
+                loadStep = LoadStep::REREAD_COPY0;
+            } else {
+                beginRebuild();
+            }
+            break;
+        case LoadStep::REREAD_COPY0:
+            if (read(0)) {
+                loadStep = LoadStep::DONE;
+            } else {
+                beginRebuild();
+            }
+            break;
+        case LoadStep::REBUILD:
+            if (!rebuildNext()) {
+                store();
+                loadStep = LoadStep::DONE;
+            }
+            break;
+        default:
+            break;
+    }
+    return isLoaded();
+}
+
+bool ProjectIndex::read(uint8_t copy) {
+    memset(entries, 0, sizeof(entries));
+    File file = SD.open(indexFilenames[copy], FILE_READ);
+    if (!file) {
+        return false;
+    }
+    bool valid = file.read(&header, sizeof(header)) == sizeof(header) && header.magic == PROJECT_INDEX_MAGIC &&
+                 header.version == PROJECT_INDEX_VERSION;
+    uint32_t crc = crc32(&header, sizeof(header));
+    // the index might have been written with a different number of slots, extra slots are ignored
+    for (uint16_t i = 0; valid && i < header.slots; i++) {
+        ProjectIndexEntry entry;
+        valid = file.read(&entry, sizeof(entry)) == sizeof(entry);
+        crc = crc32(&entry, sizeof(entry), crc);
+        if (i < PROJECTSLOTS) {
+            entries[i] = entry;
+        }
+    }
+    uint32_t storedCrc;
+    valid = valid && file.read(&storedCrc, sizeof(storedCrc)) == sizeof(storedCrc) && storedCrc == crc;
+    file.close();
+    return valid;
+}
+
+void ProjectIndex::beginRebuild() {
+    Serial.println(F("No project index, rebuilding"));
+    memset(entries, 0, sizeof(entries));
+    header.generation = 0;
+    header.modificationCounter = 0;
+    root = SD.open("/");
+    loadStep = LoadStep::REBUILD;
+}
+
+bool ProjectIndex::rebuildNext() {
+    if (!root) {
+        return false;
+    }
+    File file = root.openNextFile();
+    if (!file) {
+        root.close();
+        return false;
+    }
+    int slot = slotFromFilename(file.name());
+    if (slot >= 0 && !file.isDirectory()) {
+        entries[slot].size = file.size();
+    }
+    file.close();
+    return true;
+}
+
+bool ProjectIndex::store() {
+    header.magic = PROJECT_INDEX_MAGIC;
+    header.version = PROJECT_INDEX_VERSION;
+    header.slots = PROJECTSLOTS;
+    header.generation++;
+    // the newest copy is the one with the same parity as the generation. it is overwritten in place: it has a fixed
+    // size and fits into one sector, so once the file exists, this is a single sector write (no directory or
+    // cluster changes)
+    File file = SD.open(indexFilenames[header.generation & 1], FILE_UPDATE);
+    if (!file) {
+        Serial.println(F("Failed to write project index"));
+        return false;
+    }
+    uint32_t crc = crc32(entries, sizeof(entries), crc32(&header, sizeof(header)));
+    bool success = file.seek(0) && file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                   file.write((const uint8_t *)entries, sizeof(entries)) == sizeof(entries) &&
+                   file.write((const uint8_t *)&crc, sizeof(crc)) == sizeof(crc);
+    file.close();
+    return success;
+}
+
+void ProjectIndex::update(int slot, uint32_t size, uint32_t crc) {
+    entries[slot].size = size;
+    entries[slot].modification = ++header.modificationCounter;
+    entries[slot].crc = crc;
+    store();
+}
@@ -0,0 +1,73 @@
+#ifndef ProjectIndex_h
+#define ProjectIndex_h
+
+#include <SD.h>
+
+#define PROJECTSLOTS 16
+
+// "PIDX"
+#define PROJECT_INDEX_MAGIC 0x58444950
+#define PROJECT_INDEX_VERSION 1
+
+class ProjectIndexEntry {
+   public:
+    // file size in bytes, 0 if the slot is empty
+    uint32_t size;
+    // value of the modification counter at the last save, higher is more recent
+    uint32_t modification;
+    // crc-32 of the whole file, 0 if unknown (file was not written by a completed save)
+    uint32_t crc;
+};
+
+/*
+ * Keeps track of the project slots: which ones exist, their size, when they were saved and a checksum.
+ * The index is stored in two copies on the sd card which are written alternately (in place), each with a generation
+ * counter and a crc. If writing one copy fails halfway, the other one is still valid. If no copy is valid,
+ * the index is rebuilt with a single walk over the root directory.
+ * Loading is done in small steps (one file or one directory entry each), so it can run while the sequencer plays.
+ */
+class ProjectIndex {
+   public:
+    ProjectIndex() {
+        // no slot exists until the index is loaded
+        memset(&header, 0, sizeof(header));
+        memset(entries, 0, sizeof(entries));
+    };
+    // starts reading the newest valid copy (or rebuilding the index if there is none), continued by loadNext()
+    void beginLoad();
+    // does the next step of loading: reads one copy or one directory entry. returns true once the index is loaded.
+    bool loadNext();
+    boolean isLoaded() { return loadStep == LoadStep::DONE; }
+    // writes the index into the older of the two copies
+    bool store();
+    // records the result of a save (crc 0 if unknown) and stores the index
+    void update(int slot, uint32_t size, uint32_t crc);
+    boolean exists(int slot) { return slot >= 0 && slot < PROJECTSLOTS && entries[slot].size > 0; }
+    ProjectIndexEntry &getEntry(int slot) { return entries[slot]; }
+
+   private:
+    class Header {
+       public:
+        uint32_t magic;
+        uint16_t version;
+        uint16_t slots;
+        uint32_t generation;
+        uint32_t modificationCounter;
+    };
+
+    enum class LoadStep : uint8_t { NONE, READ_COPY0, READ_COPY1, REREAD_COPY0, REBUILD, DONE };
+
+    bool read(uint8_t copy);
+    void beginRebuild();
+    // reads the next directory entry, returns false at the end of the directory
+    bool rebuildNext();
+
+    LoadStep loadStep = LoadStep::NONE;
+    bool valid0 = false;
+    uint32_t generation0 = 0;
+    File root;
+    Header header;
+    ProjectIndexEntry entries[PROJECTSLOTS];
+};
+
+#endif
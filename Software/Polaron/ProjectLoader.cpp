@@ -0,0 +1,235 @@
+#include "ProjectLoader.h"
+#include "ProjectSnapshot.h"
+
+// path levels of a project file:
+// {"global":{..},"tracks":[{"output1Gain":..,"patterns":[{..,"steps":[{"params":[..]}]}]}],"layout":[..]}
+#define LEVEL_TRACK 1
+#define LEVEL_PATTERN 3
+#define LEVEL_STEP 5
+#define LEVEL_PARAM 7
+
+// every step of a file from before the track base parameters (a version 1 file) can have a lock
+static_assert(PARAMETER_LOCKS_PER_TRACK >= LEGACY_PATTERNS * LEGACY_STEPS, "a legacy project file does not fit into the lock pool");
+static_assert(LEGACY_STEPS <= NUMBER_OF_STEPS_PER_PATTERN, "a legacy pattern does not fit into a pattern");
+
+// returns the track the current location belongs to, NULL if the location is not inside a track
+TrackSnapshot *ProjectLoader::getTrack(JsonStreamParser &parser) {
+    if (parser.getDepth() <= LEVEL_TRACK || !parser.isKey(0, "tracks")) {
+        return NULL;
+    }
+    uint16_t t = parser.getIndex(LEVEL_TRACK);
+    if (t >= NUMBER_OF_INSTRUMENTTRACKS) {
+        return NULL;
+    }
+    return &snapshot->tracks[t];
+}
+
+// returns the pattern the current location belongs to, NULL if the location is not inside a pattern
+PatternSnapshot *ProjectLoader::getPattern(JsonStreamParser &parser) {
+    TrackSnapshot *track = getTrack(parser);
+    if (track == NULL || parser.getDepth() <= LEVEL_PATTERN || !parser.isKey(LEVEL_TRACK + 1, "patterns")) {
+        return NULL;
+    }
+    uint16_t p = parser.getIndex(LEVEL_PATTERN);
+    if (p >= NUMBER_OF_PATTERNS) {
+        return NULL;
+    }
+    return &track->patterns[p];
+}
+
+// returns the pattern of the step the current location belongs to (and the step index in step), NULL if the location
+// is not inside a step
+PatternSnapshot *ProjectLoader::getStep(JsonStreamParser &parser, uint8_t &step) {
+    PatternSnapshot *pattern = getPattern(parser);
+    if (pattern == NULL || parser.getDepth() <= LEVEL_STEP || !parser.isKey(LEVEL_PATTERN + 1, "steps")) {
+        return NULL;
+    }
+    uint16_t s = parser.getIndex(LEVEL_STEP);
+    if (s >= NUMBER_OF_STEPS_PER_PATTERN) {
+        return NULL;
+    }
+    step = s;
+    return pattern;
+}
+
+void ProjectLoader::onStart(JsonStreamParser &parser) {
+    uint8_t depth = parser.getDepth();
+    if (depth == LEVEL_TRACK + 1) {
+        TrackSnapshot *track = getTrack(parser);
+        if (track != NULL) {
+            // the locks of the track are replaced by the ones in the file
+            track->clear();
+            track->output1Gain = 0.5;
+            track->output2Gain = 0.5;
+            track->parameters.base = packParameters(sequencer->audioChannels[parser.getIndex(LEVEL_TRACK)]->getDefaultParams());
+        }
+    } else if (depth == LEVEL_PATTERN + 1) {
+        PatternSnapshot *pattern = getPattern(parser);
+        if (pattern != NULL) {
+            // older files have less steps
+            pattern->clear();
+            patternOffset = 0;
+        }
+    } else if (depth == LEVEL_STEP + 1) {
+        uint8_t s;
+        PatternSnapshot *pattern = getStep(parser, s);
+        if (pattern != NULL) {
+            stepParams = getTrack(parser)->parameters.base;
+            stepLocks = -1;
+            stepHasParams = false;
+        }
+    }
+}
+
+void ProjectLoader::onEnd(JsonStreamParser &parser) {
+    if (parser.getDepth() == LEVEL_PATTERN + 1) {
+        PatternSnapshot *pattern = getPattern(parser);
+        if (pattern != NULL) {
+            setOffset(pattern);
+        }
+        return;
+    }
+    if (parser.getDepth() != LEVEL_STEP + 1) {
+        return;
+    }
+    uint8_t s;
+    PatternSnapshot *pattern = getStep(parser, s);
+    if (pattern == NULL || !stepHasParams) {
+        return;
+    }
+    TrackParameters &parameters = getTrack(parser)->parameters;
+    uint8_t mask = stepLocks;
+    if (stepLocks < 0) {
+        // older file, every parameter that is not the default is a lock
+        mask = 0;
+        for (int p = 0; p < NUMBER_OF_STEP_PARAMETERS; p++) {
+            if (unpackParameter(stepParams, p) != unpackParameter(parameters.base, p)) {
+                mask |= 1 << p;
+            }
+        }
+    }
+    pattern->steps.locks[s] = getLock(getTrack(parser), parser.getIndex(LEVEL_PATTERN), s, mask);
+    if (mask != 0 && pattern->steps.locks[s] == NO_PARAMETER_LOCK) {
+        tooManyLocks = true;
+    }
+}
+
+LockIndex ProjectLoader::getLock(TrackSnapshot *track, PatternIndex pattern, uint8_t step, uint8_t mask) {
+    TrackParameters &parameters = track->parameters;
+    if (mask == 0) {
+        return NO_PARAMETER_LOCK;
+    }
+    PackedParameterSet locked = parameterFieldMask(mask);
+    for (int p = 0; p < pattern; p++) {
+        LockIndex lock = track->patterns[p].steps.locks[step];
+        if (parameters.getMask(lock) == mask && (parameters.values[lock] & locked) == (stepParams & locked)) {
+            parameters.retain(lock);
+            return lock;
+        }
+    }
+    return parameters.create(mask, stepParams);
+}
+
+void ProjectLoader::setOffset(PatternSnapshot *pattern) {
+    if (fileVersion < 2) {
+        if (patternOffset % LEGACY_STEPS != 0) {
+            rotateLegacySteps(pattern, patternOffset % LEGACY_STEPS);
+        }
+        pattern->offset = 0;
+    } else {
+        pattern->offset = patternOffset % pattern->trackLength;
+    }
+}
+
+void ProjectLoader::rotateLegacySteps(PatternSnapshot *pattern, uint8_t offset) {
+    // step b is played at the position of step b - offset
+    StepData rotated = pattern->steps;
+    StepMask triggers = pattern->triggerState;
+    StepMask pLocks = pattern->pLockArmState;
+    for (int b = 0; b < LEGACY_STEPS; b++) {
+        uint8_t from = (offset + b) % LEGACY_STEPS;
+        rotated.locks[b] = pattern->steps.locks[from];
+        rotated.setTriggerMask(b, pattern->steps.getTriggerMask(from));
+        triggers = (pattern->triggerState & stepBit(from)) ? triggers | stepBit(b) : triggers & ~stepBit(b);
+        pLocks = (pattern->pLockArmState & stepBit(from)) ? pLocks | stepBit(b) : pLocks & ~stepBit(b);
+    }
+    pattern->steps = rotated;
+    pattern->triggerState = triggers;
+    pattern->pLockArmState = pLocks;
+}
+
+void ProjectLoader::onValue(JsonStreamParser &parser, int64_t value, float floatValue) {
+    uint8_t depth = parser.getDepth();
+    if (depth == 2 && parser.isKey(0, "global")) {
+        if (parser.isKey(1, "stepLength")) {
+            snapshot->stepLength = value;
+        } else if (parser.isKey(1, "swing")) {
+            snapshot->swing = floatValue;
+        } else if (parser.isKey(1, "version")) {
+            fileVersion = value;
+        }
+    } else if (depth == 2 && parser.isKey(0, "layout")) {
+        uint16_t r = parser.getIndex(1);
+        if (r < NUMBER_OF_INSTRUMENTTRACKS * NUMBER_OF_PATTERNS) {
+            snapshot->recordSectors[r] = value;
+        } else {
+            // written with other dimensions, the layout does not fit
+            snapshot->recordSectors[0] = 0;
+        }
+    } else if (depth == LEVEL_TRACK + 2) {
+        TrackSnapshot *track = getTrack(parser);
+        if (track == NULL) {
+            return;
+        }
+        if (parser.isKey(LEVEL_TRACK + 1, "output1Gain")) {
+            track->output1Gain = floatValue;
+        } else if (parser.isKey(LEVEL_TRACK + 1, "output2Gain")) {
+            track->output2Gain = floatValue;
+        }
+    } else if (depth == LEVEL_TRACK + 3 && parser.isKey(LEVEL_TRACK + 1, "params")) {
+        TrackSnapshot *track = getTrack(parser);
+        uint16_t p = parser.getIndex(LEVEL_TRACK + 2);
+        if (track != NULL && p < NUMBER_OF_STEP_PARAMETERS) {
+            track->parameters.base = setPackedParameter(track->parameters.base, p, value);
+        }
+    } else if (depth == LEVEL_PATTERN + 2) {
+        PatternSnapshot *pattern = getPattern(parser);
+        if (pattern == NULL) {
+            return;
+        }
+        if (parser.isKey(LEVEL_PATTERN + 1, "triggerState")) {
+            pattern->triggerState = value;
+        } else if (parser.isKey(LEVEL_PATTERN + 1, "pLockArmState")) {
+            pattern->pLockArmState = value;
+        } else if (parser.isKey(LEVEL_PATTERN + 1, "offset")) {
+            // applied at the end of the pattern (see setOffset)
+            patternOffset = value < 0 ? 0 : value;
+        } else if (parser.isKey(LEVEL_PATTERN + 1, "trackLength")) {
+            pattern->trackLength = value < 1 ? 1 : value > NUMBER_OF_STEPS_PER_PATTERN ? NUMBER_OF_STEPS_PER_PATTERN : value;
+        } else if (parser.isKey(LEVEL_PATTERN + 1, "autoMutate")) {
+            pattern->autoMutate = value;
+        }
+    } else if (depth == LEVEL_STEP + 2) {
+        uint8_t s;
+        PatternSnapshot *pattern = getStep(parser, s);
+        if (pattern == NULL) {
+            return;
+        }
+        if (parser.isKey(LEVEL_STEP + 1, "triggerMask")) {
+            pattern->steps.setTriggerMask(s, value);
+        } else if (parser.isKey(LEVEL_STEP + 1, "locks")) {
+            stepLocks = value & 0b00111111;
+        }
+    } else if (depth == LEVEL_PARAM + 1) {
+        uint8_t s;
+        PatternSnapshot *pattern = getStep(parser, s);
+        if (pattern == NULL || !parser.isKey(LEVEL_STEP + 1, "params")) {
+            return;
+        }
+        uint16_t p = parser.getIndex(LEVEL_PARAM);
+        if (p < NUMBER_OF_STEP_PARAMETERS) {
+            stepParams = setPackedParameter(stepParams, p, value);
+            stepHasParams = true;
+        }
+    }
+}
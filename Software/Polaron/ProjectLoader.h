@@ -0,0 +1,73 @@
+#ifndef ProjectLoader_h
+#define ProjectLoader_h
+
+#include "JsonStreamParser.h"
+#include "ParameterSet.h"
+#include "TrackParameters.h"
+
+// version of the project files that are written. files without a version (1) are from before the 64 step patterns:
+// they have 16 steps per pattern, which are rotated over all 16 steps whatever the track length.
+#define PROJECT_FILE_VERSION 2
+// dimensions of a version 1 file
+#define LEGACY_PATTERNS 16
+#define LEGACY_STEPS 16
+
+class Sequencer;
+class ProjectSnapshot;
+class TrackSnapshot;
+class PatternSnapshot;
+
+/*
+ * Writes the values of a project file into a project snapshot while the file is parsed.
+ * A track in the file replaces the whole track of the snapshot. Values missing in a track, pattern or step are set to
+ * the same defaults the sequencer starts with (patterns missing in a track are empty), anything else that is missing
+ * keeps the value the snapshot had before.
+ * Files from before the track base parameters have all parameters in every step: the parameters that differ from the
+ * defaults of the track become parameter locks. Equal locks at the same step of several patterns (copied patterns)
+ * are shared, like the sequencer shares them.
+ * The parsing stops if a track has more locks than fit into its pool, the snapshot is not usable then.
+ * Track lengths and rotations outside of the pattern are clamped, the rotation of a version 1 file is applied to its
+ * steps (it wrapped at 16 steps instead of the track length).
+ */
+class ProjectLoader : public JsonStreamListener {
+   public:
+    ProjectLoader(){};
+    // the default parameters of the tracks are taken from the audio channels of the sequencer
+    void setTarget(ProjectSnapshot *target, Sequencer *sequencer) {
+        snapshot = target;
+        this->sequencer = sequencer;
+        tooManyLocks = false;
+        fileVersion = 1;
+    }
+    void onStart(JsonStreamParser &parser);
+    void onEnd(JsonStreamParser &parser);
+    void onValue(JsonStreamParser &parser, int64_t value, float floatValue);
+    bool isStopped() { return tooManyLocks; }
+    // the parsing stopped since a track has more locks than fit into its pool
+    bool hasTooManyLocks() { return tooManyLocks; }
+
+   private:
+    TrackSnapshot *getTrack(JsonStreamParser &parser);
+    PatternSnapshot *getPattern(JsonStreamParser &parser);
+    PatternSnapshot *getStep(JsonStreamParser &parser, uint8_t &step);
+    // returns a lock of the track with the values of the current step
+    LockIndex getLock(TrackSnapshot *track, PatternIndex pattern, uint8_t step, uint8_t mask);
+    // sets the rotation of a pattern at its end, when its length is known
+    void setOffset(PatternSnapshot *pattern);
+    // moves the steps of a version 1 pattern to the positions they are played at
+    void rotateLegacySteps(PatternSnapshot *pattern, uint8_t offset);
+
+    ProjectSnapshot *snapshot = NULL;
+    Sequencer *sequencer = NULL;
+    // the parameters of the current step are collected until the end of the step
+    PackedParameterSet stepParams;
+    // value of "locks", -1 if the step has none
+    int8_t stepLocks;
+    bool stepHasParams;
+    bool tooManyLocks;
+    uint8_t fileVersion;
+    // value of "offset" of the current pattern
+    uint32_t patternOffset;
+};
+
+#endif
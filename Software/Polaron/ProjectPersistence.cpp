@@ -3,191 +3,681 @@
 #include "ArduinoJson-v6.11.0.h"
 #include "Sequencer.h"
 #include "ParameterSet.h"
+#include "ProjectSnapshot.h"
+#include "ProjectLoader.h"
+#include "ProjectCache.h"
+#include "JsonStreamParser.h"
+#include "SectorWriter.h"
+#include "Crc32.h"
+#include "Trace.h"
 #include "Arduino.h"
 
-#define PROJECTSLOTS 16
+// one chunk for the header, one for each pattern of each track and one for the layout at the end of the file
+#define PATTERN_CHUNKS (NUMBER_OF_INSTRUMENTTRACKS * NUMBER_OF_PATTERNS)
+#define SAVE_CHUNKS (PATTERN_CHUNKS + 2)
+#define LAYOUT_CHUNK (SAVE_CHUNKS - 1)
+
+// Project files are made of records: the header (clock settings), one record per pattern and the layout. Each record
+// starts at a sector boundary and is padded with whitespace to whole sectors, so a record takes as many sectors as
+// its content needs. The file stays valid json, but a changed pattern can be rewritten in place as long as it still
+// fits into its sectors. The layout at the end of the file lists the sectors of the pattern records.
+#define RECORD_ALIGNMENT SECTOR_SIZE
+// upper bounds for the json written per record (steps with the default trigger mask and without locks are {}):
+// {"triggerMask":255,"locks":63,"params":[1023,1023,1023,1023,1023,1023]},
+#define STEP_JSON_MAX_LENGTH 72
+// {"triggerState":65535,"pLockArmState":65535,"offset":255,"trackLength":255,"autoMutate":false,"steps":[...]}
+// (the masks have as many digits as the largest value of StepMask)
+#define STEP_MASK_JSON_MAX_LENGTH (sizeof(StepMask) == 1 ? 3 : sizeof(StepMask) == 2 ? 5 : sizeof(StepMask) == 4 ? 10 : 20)
+#define PATTERN_JSON_MAX_LENGTH (95 + 2 * STEP_MASK_JSON_MAX_LENGTH + NUMBER_OF_STEPS_PER_PATTERN * STEP_JSON_MAX_LENGTH)
+// {"output1Gain":...,"output2Gain":...,"params":[...],"patterns":[ before the first pattern of a track and ]},/]}]
+// after the last
+#define TRACK_JSON_MAX_LENGTH 125
+#define PATTERN_RECORD_MAX_SECTORS \
+    ((PATTERN_JSON_MAX_LENGTH + TRACK_JSON_MAX_LENGTH + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT)
+static_assert(PATTERN_RECORD_MAX_SECTORS < 256, "the sectors of a record do not fit into the layout");
+#define HEADER_RECORD_SIZE RECORD_ALIGNMENT
+// a record is written in parts, so a save does not exceed its time budget by more than a sector write: the start of
+// the record (the header or the layout as a whole), each step of a pattern, the end of a pattern, then the padding
+// sector by sector
+#define RECORD_PART_END (NUMBER_OF_STEPS_PER_PATTERN + 1)
+#define RECORD_PART_PADDING (NUMBER_OF_STEPS_PER_PATTERN + 2)
+// a delta save measures the changed patterns before it starts (to know if they still fit into their records), that
+// takes about as long as writing them. with more changed patterns, the whole file is written.
+#define DELTA_SAVE_MAX_CHANGED_RECORDS 16
+
+// open for in place updates (FILE_WRITE appends on some versions of the sd lib)
+#define FILE_UPDATE (O_RDWR | O_CREAT)
+
+// the snapshot the background save is writing from. kept static, it is too big for the stack.
+static ProjectSnapshot snapshot;
+// all output goes through one sector buffer, nothing is allocated while saving
+static SectorWriter writer;
+// recently used projects, in the same form as the snapshot
+static ProjectCache cache;
+// reads project files into the cache
+static ProjectLoader loader;
+// state of the background prefill of the cache
+static JsonStreamParser prefillParser;
+static ProjectSnapshot *prefillTarget = NULL;
+
+// counts the output instead of writing it, to measure a record before it is written
+class LengthCounter : public Print {
+   public:
+    size_t write(uint8_t b) {
+        length++;
+        return 1;
+    }
+    size_t write(const uint8_t *data, size_t size) {
+        length += size;
+        return size;
+    }
+    uint32_t length = 0;
+};
+
+// returns the file name of a project slot. the name is kept in a static buffer, which is overwritten by the next call.
+static const char * projectFilename(int projectNum){
+    static char filename[20];
+    sprintf(filename, "/p_%i.txt", projectNum);
+    return filename;
+}
 
 void ProjectPersistence::init(){
-    int attempts = 4;
-    while (!sdCardInitialized && attempts-- > 0) {
-        sdCardInitialized = SD.begin(BUILTIN_SDCARD);
-        Serial.println(F("Failed to initialize SD library"));
-        delay(1000);
+    // the card is initialized by update(), so the sequencer can start playing right away
+    initAttempts = SD_INIT_ATTEMPTS;
+    nextInitAttempt = millis();
+}
+
+void ProjectPersistence::initNextAttempt(Sequencer * sequencer){
+    // SD.begin() can block for a long time (and can not be split up), it waits until the sequencer is stopped
+    if (initAttempts == 0 || (int32_t)(millis() - nextInitAttempt) < 0 || sequencer->isRunning()){
+        return;
     }
+    initAttempts--;
+    TRACE_EVENT(SD_START, TraceSdOp::INIT, initAttempts);
+    sdCardInitialized = SD.begin(BUILTIN_SDCARD);
     if (sdCardInitialized){
         Serial.println(F("SD lib initialized"));
-        updateProjectList();
+        // the index is read by the next calls to update()
+        index.beginLoad();
+    } else if (initAttempts > 0){
+        Serial.println(F("Failed to initialize SD library"));
+        nextInitAttempt = millis() + SD_INIT_RETRY_MILLIS;
     } else {
         Serial.println(F("Failed to initialize SD library, giving up"));
     }
+    TRACE_EVENT(SD_END, TraceSdOp::INIT, initAttempts);
+}
+
+bool ProjectPersistence::startSave(int projectNum, Sequencer * sequencer){
+    if (!isReady() || isSaving()){
+        return false;
+    }
+    // the snapshot is needed for the save, the session can be stored later
+    session.abort();
+    cancelPrefill();
+    snapshot.capture(sequencer);
+    // if the file is the one we loaded / saved last, only the changed records are rewritten (in place, its clusters
+    // are already allocated). otherwise the file is written from scratch, each record as long as it needs to be.
+    deltaSave = projectNum == syncedProject && prepareDeltaSave();
+    // the file is removed / opened by the next calls to update()
+    saveStep = deltaSave ? SaveStep::OPEN : SaveStep::REMOVE;
+    // from now on, changes are tracked relative to the project that is being saved
+    sequencer->clock.clearDirty();
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++){
+        sequencer->tracks[t].clearDirty();
+    }
+    syncedProject = projectNum;
+    savingProject = projectNum;
+    nextChunk = 0;
+    nextPart = 0;
+    recordStart = 0;
+    writer.resetCrc();
+    return true;
 }
 
-void ProjectPersistence::updateProjectList(){
-    existingProjects = 0;
-    for (int i = 0; i < PROJECTSLOTS; i++){
-        char* filename = new char[20];
-        sprintf(filename, "/p_%i.txt", i);
-        if (SD.exists(filename)){
-            existingProjects |= _BV(i);
+// takes over the layout of the synced file, if the changed patterns still fit into their records
+bool ProjectPersistence::prepareDeltaSave(){
+    uint8_t changed = 0;
+    for (uint16_t chunk = 1; chunk <= PATTERN_CHUNKS; chunk++){
+        if (!isRecordChanged(chunk)){
+            continue;
+        }
+        if (++changed > DELTA_SAVE_MAX_CHANGED_RECORDS){
+            return false;
+        }
+        uint8_t t = (chunk - 1) / NUMBER_OF_PATTERNS;
+        PatternIndex p = (chunk - 1) % NUMBER_OF_PATTERNS;
+        LengthCounter counter;
+        writePatternStart(counter, t, p);
+        for (int s = 0; s < NUMBER_OF_STEPS_PER_PATTERN; s++){
+            writeStep(counter, t, p, s);
+        }
+        writePatternEnd(counter, t, p);
+        if (counter.length > (uint32_t)syncedLayout[chunk - 1] * RECORD_ALIGNMENT){
+            return false;
         }
     }
+    memcpy(snapshot.recordSectors, syncedLayout, sizeof(syncedLayout));
+    return true;
 }
 
-void ProjectPersistence::save(int projectNum, Sequencer * sequencer){
-    char* filename = new char[20];
-    sprintf(filename, "/p_%i.txt", projectNum);
-    // Serial.print(F("Storing to file: "));
-    // Serial.println(filename);
-    // Delete existing file, otherwise the configuration is appended to the file
-    SD.remove(filename);
+void ProjectPersistence::update(Sequencer * sequencer){
+    if (!sdCardInitialized){
+        initNextAttempt(sequencer);
+    } else if (!index.isLoaded()){
+        TRACE_EVENT(SD_START, TraceSdOp::INIT, 0);
+        index.loadNext();
+        TRACE_EVENT(SD_END, TraceSdOp::INIT, 0);
+    }
+    if (!isSaving()){
+        if (isReady()){
+            updatePrefill(sequencer);
+        }
+        updateSession(sequencer);
+        return;
+    }
+    // write at least one part per call, then continue as long as there is time left. the other steps take a call of
+    // their own.
+    TRACE_EVENT(SD_START, TraceSdOp::SAVE, nextChunk);
+    uint32_t start = micros();
+    bool writing;
+    do {
+        writing = saveStep == SaveStep::WRITE;
+        writeNextPart();
+    } while (writing && isSaving() && saveStep == SaveStep::WRITE && micros() - start < SAVE_TIME_BUDGET_MICROS);
+    TRACE_EVENT(SD_END, TraceSdOp::SAVE, nextChunk);
+}
 
-    // Open file for writing
-    File file = SD.open(filename, FILE_WRITE);
-    if (!file) {
-        Serial.println(F("Failed to create file"));
+// keeps a copy of the current state in flash, so it can be restored after a power cycle
+void ProjectPersistence::updateSession(Sequencer * sequencer){
+    if (!session.isAvailable()){
+        return;
+    }
+    // erasing blocks for several ms, the next record is only erased while the sequencer is stopped
+    if (session.isStoring() || (!session.isPrepared() && !sequencer->isRunning())){
+        TRACE_EVENT(SD_START, TraceSdOp::SESSION, 0);
+        session.update(!sequencer->isRunning());
+        TRACE_EVENT(SD_END, TraceSdOp::SESSION, 0);
+        return;
+    }
+    if (!session.isPrepared() || millis() - lastSessionCheck < SESSION_AUTOSAVE_MILLIS ||
+        (lastSessionStore != 0 && millis() - lastSessionStore < SESSION_STORE_MIN_INTERVAL_MILLIS)){
         return;
     }
-    file.print("{\"global\":");
+    lastSessionCheck = millis();
+    snapshot.capture(sequencer);
+    // the dirty flags only matter for the sd card, they should not cause a new session
+    snapshot.clearDirty();
+    uint32_t crc = crc32(&snapshot, sizeof(snapshot));
+    if (crc != session.getStoredCrc() && session.startStore(snapshot, crc)){
+        lastSessionStore = millis();
+    }
+}
+
+bool ProjectPersistence::restoreSession(Sequencer * sequencer){
+    if (!session.restore(snapshot)){
+        return false;
+    }
+    snapshot.apply(sequencer);
+    lastSessionCheck = millis();
+    Serial.println(F("Restored session"));
+    return true;
+}
+
+uint8_t ProjectPersistence::getSaveProgress(uint8_t scale){
+    return isSaving() ? (uint32_t)nextChunk * scale / SAVE_CHUNKS : 0;
+}
+
+bool ProjectPersistence::isChunkDirty(uint16_t chunk){
+    // the layout is the same as long as the records are rewritten in place
+    return !deltaSave || (chunk != LAYOUT_CHUNK && isRecordChanged(chunk));
+}
+
+// returns true if the content of a record was changed since the last load / save
+bool ProjectPersistence::isRecordChanged(uint16_t chunk){
+    if (chunk == 0){
+        return snapshot.clockDirty;
+    }
+    uint16_t patternChunk = chunk - 1;
+    TrackSnapshot & track = snapshot.tracks[patternChunk / NUMBER_OF_PATTERNS];
+    PatternIndex p = patternChunk % NUMBER_OF_PATTERNS;
+    // the track settings are stored together with the first pattern
+    return track.patterns[p].dirty || (p == 0 && track.settingsDirty);
+}
+
+// returns the end of the record of nextChunk, once its content is written
+uint32_t ProjectPersistence::getRecordEnd(){
+    if (nextChunk == 0){
+        return HEADER_RECORD_SIZE;
+    }
+    uint8_t & sectors = snapshot.recordSectors[nextChunk - 1];
+    if (sectors == 0){
+        // a new layout, the record takes as many sectors as its content needs
+        sectors = (writer.getPosition() - recordStart + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT;
+    }
+    return recordStart + (uint32_t)sectors * RECORD_ALIGNMENT;
+}
+
+void ProjectPersistence::writeNextPart(){
+    switch (saveStep){
+        case SaveStep::REMOVE:
+            SD.remove(projectFilename(savingProject));
+            saveStep = SaveStep::OPEN;
+            return;
+        case SaveStep::OPEN:
+            saveFile = SD.open(projectFilename(savingProject), FILE_UPDATE);
+            if (!saveFile) {
+                Serial.println(F("Failed to create file"));
+                // the dirty flags are cleared, the next save needs to write everything
+                syncedProject = -1;
+                savingProject = -1;
+                return;
+            }
+            saveStep = SaveStep::WRITE;
+            return;
+        case SaveStep::WRITE:
+            break;
+        case SaveStep::CLOSE:
+            saveFile.close();
+            saveStep = SaveStep::STORE_INDEX;
+            return;
+        case SaveStep::STORE_INDEX:
+            // the index is only updated once the file is complete
+            index.update(savingProject, writer.getPosition(), writer.getCrc());
+            saveStep = SaveStep::CACHE;
+            return;
+        case SaveStep::CACHE:
+            finishSave();
+            return;
+    }
+    uint16_t patternChunk = nextChunk - 1;
+    uint8_t t = patternChunk / NUMBER_OF_PATTERNS;
+    PatternIndex p = patternChunk % NUMBER_OF_PATTERNS;
+    if (nextPart == 0){
+        // records that did not change are not written, but they are generated for the crc of the file (the same as
+        // reading them back, as long as the file is in sync with the snapshot, and much faster)
+        if (!writer.begin(saveFile, recordStart, isChunkDirty(nextChunk))){
+            failSave();
+            return;
+        }
+        if (nextChunk == 0){
+            if (!writeHeader()){
+                failSave();
+                return;
+            }
+            nextPart = RECORD_PART_PADDING;
+        } else if (nextChunk == LAYOUT_CHUNK){
+            // the file ends with the layout, it is not padded
+            writeLayout();
+            writer.finish();
+            nextChunk++;
+        } else {
+            writePatternStart(writer, t, p);
+            nextPart++;
+        }
+    } else if (nextPart < RECORD_PART_END){
+        writeStep(writer, t, p, nextPart - 1);
+        nextPart++;
+    } else if (nextPart == RECORD_PART_END){
+        writePatternEnd(writer, t, p);
+        nextPart++;
+    } else {
+        // fill up the record with whitespace, one sector at a time. records are sector aligned, so the last sector is
+        // written out when the end of the record is reached.
+        uint32_t recordEnd = getRecordEnd();
+        uint32_t sectorEnd = (writer.getPosition() / SECTOR_SIZE + 1) * SECTOR_SIZE;
+        writer.padTo(sectorEnd < recordEnd ? sectorEnd : recordEnd);
+        if (writer.getPosition() == recordEnd){
+            recordStart = recordEnd;
+            nextPart = 0;
+            nextChunk++;
+        }
+    }
+    if (writer.hasFailed()){
+        failSave();
+    } else if (nextChunk == SAVE_CHUNKS){
+        saveStep = SaveStep::CLOSE;
+    }
+}
+
+void ProjectPersistence::failSave(){
+    Serial.println(F("Failed to write to file"));
+    // the file is in an unknown state, the next save needs to write everything. the index keeps the entry from
+    // before the save (a new slot does not show up as existing).
+    syncedProject = -1;
+    saveFile.close();
+    savingProject = -1;
+}
+
+bool ProjectPersistence::writeHeader(){
+    writer.print("{\"global\":");
     StaticJsonDocument<200> clockDoc;
     JsonObject clock = clockDoc.to<JsonObject>();
-    clock["stepLength"] = sequencer->clock.getStepLength();
-    clock["swing"] = sequencer->clock.getSwing();
-    if (serializeJson(clockDoc, file) == 0) {
-        Serial.println(F("Failed to write to file"));
+    clock["stepLength"] = snapshot.stepLength;
+    clock["swing"] = snapshot.swing;
+    clock["version"] = PROJECT_FILE_VERSION;
+    if (serializeJson(clockDoc, writer) == 0) {
+        return false;
     }
-    file.print(",");
+    writer.print(",");
+    writer.print("\"tracks\":[");
+    return true;
+}
 
-    // we serialize track by track in order to save memory.
-    file.print("\"tracks\":[");
-    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++){
-        StaticJsonDocument<40000> trackDoc;
-        JsonObject track = trackDoc.to<JsonObject>();
-        track["output1Gain"] = sequencer->audioChannels[t]->getOutput1Gain();
-        track["output2Gain"] = sequencer->audioChannels[t]->getOutput2Gain();
-        JsonArray patterns = track.createNestedArray("patterns");
-        for (int p = 0; p < NUMBER_OF_PATTERNS; p++){
-            JsonObject pattern = patterns.createNestedObject();
-            SequencerPattern & sequencerPattern = sequencer->tracks[t].patterns[p];
-            pattern["triggerState"] = sequencerPattern.triggerState;
-            pattern["pLockArmState"] = sequencerPattern.pLockArmState;
-            pattern["offset"] = sequencerPattern.offset;
-            pattern["trackLength"] = sequencerPattern.trackLength;
-            pattern["autoMutate"] = sequencerPattern.autoMutate;
-            JsonArray steps = pattern.createNestedArray("steps");
-            for (int s = 0; s < NUMBER_OF_STEPS_PER_PATTERN; s++){
-                JsonObject step = steps.createNestedObject();
-                SequencerStep & sequencerStep = sequencerPattern.steps[s];
-                step["triggerMask"] = sequencerStep.triggerMask;
-                JsonArray stepParams = step.createNestedArray("params");
-                ParameterSet params = sequencerStep.params;
-                stepParams.add(params.parameter1);
-                stepParams.add(params.parameter2);
-                stepParams.add(params.parameter3);
-                stepParams.add(params.parameter4);
-                stepParams.add(params.parameter5);
-                stepParams.add(params.parameter6);
+// closes the project object
+void ProjectPersistence::writeLayout(){
+    writer.print(",\"layout\":[");
+    for (int r = 0; r < PATTERN_CHUNKS; r++){
+        if (r > 0){
+            writer.print(",");
+        }
+        writer.print((int)snapshot.recordSectors[r]);
+    }
+    writer.print("]}");
+}
+
+// we serialize pattern by pattern (and step by step) in order to save memory and to keep the parts small.
+void ProjectPersistence::writePatternStart(Print &out, uint8_t t, PatternIndex p){
+    TrackSnapshot & track = snapshot.tracks[t];
+    if (p == 0){
+        // the track object is opened together with its first pattern
+        out.print("{\"output1Gain\":");
+        out.print(track.output1Gain, 6);
+        out.print(",\"output2Gain\":");
+        out.print(track.output2Gain, 6);
+        out.print(",\"params\":[");
+        for (int n = 0; n < NUMBER_OF_STEP_PARAMETERS; n++){
+            if (n > 0){
+                out.print(",");
             }
+            out.print(unpackParameter(track.parameters.base, n));
         }
-        if (serializeJson(trackDoc, file) == 0) {
-            Serial.println(F("Failed to write to file"));
+        out.print("],\"patterns\":[");
+    } else {
+        out.print(",");
+    }
+
+    // patterns are written directly (no json document), a pattern with all its steps would need several kB of stack
+    PatternSnapshot & pattern = track.patterns[p];
+    out.print("{\"triggerState\":");
+    printMask(out, pattern.triggerState);
+    out.print(",\"pLockArmState\":");
+    printMask(out, pattern.pLockArmState);
+    out.print(",\"offset\":");
+    out.print((int)pattern.offset);
+    out.print(",\"trackLength\":");
+    out.print((int)pattern.trackLength);
+    out.print(pattern.autoMutate ? ",\"autoMutate\":true" : ",\"autoMutate\":false");
+    out.print(",\"steps\":[");
+}
+
+void ProjectPersistence::writeStep(Print &out, uint8_t t, PatternIndex p, StepIndex s){
+    TrackSnapshot & track = snapshot.tracks[t];
+    PatternSnapshot & pattern = track.patterns[p];
+    out.print(s == 0 ? "{" : ",{");
+    // the defaults (all trigger conditions on, no locks) are left out, the loader sets them for every step
+    uint8_t triggerMask = pattern.steps.getTriggerMask(s);
+    bool defaultTriggerMask = triggerMask == (1 << TRIGGER_MASK_BITS) - 1;
+    if (!defaultTriggerMask){
+        out.print("\"triggerMask\":");
+        out.print((int)triggerMask);
+    }
+    LockIndex lock = pattern.steps.locks[s];
+    if (lock != NO_PARAMETER_LOCK){
+        // all parameters of the step are written (not only the locked ones), so the file also plays the same in
+        // firmware versions without base parameters
+        out.print(defaultTriggerMask ? "\"locks\":" : ",\"locks\":");
+        out.print((int)track.parameters.getMask(lock));
+        out.print(",\"params\":[");
+        PackedParameterSet params = track.parameters.get(lock);
+        for (int n = 0; n < NUMBER_OF_STEP_PARAMETERS; n++){
+            if (n > 0){
+                out.print(",");
+            }
+            out.print(unpackParameter(params, n));
         }
-        if (t < NUMBER_OF_INSTRUMENTTRACKS - 1){
-            file.print(",");
+        out.print("]");
+    }
+    out.print("}");
+}
+
+void ProjectPersistence::writePatternEnd(Print &out, uint8_t t, PatternIndex p){
+    out.print("]}");
+
+    if (p == NUMBER_OF_PATTERNS - 1){
+        // close the patterns array and the track object
+        out.print("]}");
+        // and the tracks array after the last track (the layout follows)
+        out.print(t < NUMBER_OF_INSTRUMENTTRACKS - 1 ? "," : "]");
+    }
+}
+
+// prints a step mask as decimal number (Print has no 64bit numbers)
+void ProjectPersistence::printMask(Print &out, StepMask mask){
+    char digits[21];
+    uint8_t position = sizeof(digits) - 1;
+    digits[position] = 0;
+    do {
+        digits[--position] = '0' + mask % 10;
+        mask /= 10;
+    } while (mask > 0);
+    out.print(digits + position);
+}
+
+// the file and the index are written, takes over the saved snapshot
+void ProjectPersistence::finishSave(){
+    memcpy(syncedLayout, snapshot.recordSectors, sizeof(syncedLayout));
+    // the saved project is the most recently used one, keep it in the cache
+    ProjectSnapshot * cached = cache.allocate(savingProject, index.getEntry(savingProject).modification);
+    *cached = snapshot;
+    cache.complete(cached);
+    prefillStopped = false;
+    savingProject = -1;
+    Serial.println(deltaSave ? F("Finished delta save") : F("Finished save"));
+}
+
+bool ProjectPersistence::load(int projectNum, Sequencer * sequencer){
+    if (!isReady()){
+        return false;
+    }
+    if (isSaving()){
+        // dont touch the sequencer (or the sd card) while a save is in progress
+        Serial.println(F("Save in progress, can not load"));
+        return false;
+    }
+    cancelPrefill();
+    prefillStopped = false;
+    pendingProject = -1;
+    ProjectSnapshot * project = cache.get(projectNum, index.getEntry(projectNum).modification);
+    if (project == NULL){
+        project = readProject(projectNum, sequencer);
+        if (project == NULL){
+            return false;
         }
     }
-    file.print("]}");
-    // Close the file
-    file.close();
-    updateProjectList();
-    Serial.println(F("Finished save"));
+    applyProject(projectNum, project, sequencer);
+    return true;
 };
 
-void ProjectPersistence::load(int projectNum, Sequencer * sequencer){
-    char* filename = new char[20];
-    sprintf(filename, "/p_%i.txt", projectNum);
-    // Open file for writing
-    File file = SD.open(filename, FILE_READ);
+bool ProjectPersistence::requestLoad(int projectNum){
+    if (!isReady() || !index.exists(projectNum)){
+        return false;
+    }
+    if (prefillProject >= 0 && prefillProject != projectNum){
+        // read the requested project first
+        cancelPrefill();
+    }
+    pendingProject = projectNum;
+    prefillStopped = false;
+    return true;
+}
+
+boolean ProjectPersistence::isLoadReady(){
+    return pendingProject >= 0 && isCached(pendingProject);
+}
+
+void ProjectPersistence::finishLoad(Sequencer * sequencer){
+    ProjectSnapshot * project = cache.get(pendingProject, index.getEntry(pendingProject).modification);
+    if (project != NULL){
+        applyProject(pendingProject, project, sequencer);
+    }
+    pendingProject = -1;
+}
+
+void ProjectPersistence::applyProject(int projectNum, ProjectSnapshot * project, Sequencer * sequencer){
+    project->apply(sequencer);
+
+    // the loaded project is in sync with the file, as long as the layout of its records is known (older files need a
+    // full rewrite on the next save)
+    if (project->hasRecordLayout()){
+        memcpy(syncedLayout, project->recordSectors, sizeof(syncedLayout));
+        syncedProject = projectNum;
+    } else {
+        syncedProject = -1;
+    }
+    sequencer->clock.clearDirty();
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++){
+        sequencer->tracks[t].clearDirty();
+    }
+    activeProject = projectNum;
+    Serial.println(F("Finished load"));
+}
+
+// reads a project file into the cache. returns NULL if the file can not be read, the sequencer is not changed.
+ProjectSnapshot * ProjectPersistence::readProject(int projectNum, Sequencer * sequencer){
+    TRACE_EVENT(SD_START, TraceSdOp::LOAD, projectNum);
+    ProjectSnapshot * project = readProjectFile(projectNum, sequencer);
+    TRACE_EVENT(SD_END, TraceSdOp::LOAD, projectNum);
+    return project;
+}
+
+ProjectSnapshot * ProjectPersistence::readProjectFile(int projectNum, Sequencer * sequencer){
+    File file = SD.open(projectFilename(projectNum), FILE_READ);
     if (!file) {
         Serial.println(F("Failed to read file"));
+        return NULL;
+    }
+    ProjectSnapshot * project = cache.allocate(projectNum, index.getEntry(projectNum).modification);
+    // values that are missing in the file keep their current value
+    project->capture(sequencer);
+    // the file is parsed as a stream, values are written into the snapshot as they are read.
+    loader.setTarget(project, sequencer);
+    JsonStreamParser parser;
+    bool success = parser.parse(file, loader);
+    file.close();
+    if (!success) {
+        Serial.println(loader.hasTooManyLocks() ? F("Too many parameter locks in project file") : F("Failed to parse project file"));
+        cache.remove(project);
+        return NULL;
+    }
+    cache.complete(project);
+    return project;
+}
+
+ProjectSnapshot * ProjectPersistence::parseFile(const char * filename, Sequencer * sequencer){
+    if (!isReady() || isSaving()){
+        return NULL;
+    }
+    File file = SD.open(filename, FILE_READ);
+    if (!file) {
+        return NULL;
+    }
+    // the session store programs the snapshot to flash, it can be stored later. the prefill uses the same loader.
+    session.abort();
+    cancelPrefill();
+    prefillStopped = false;
+    snapshot.capture(sequencer);
+    loader.setTarget(&snapshot, sequencer);
+    JsonStreamParser parser;
+    bool success = parser.parse(file, loader);
+    file.close();
+    if (!success) {
+        Serial.println(loader.hasTooManyLocks() ? F("Too many parameter locks in project file") : F("Failed to parse project file"));
+        return NULL;
+    }
+    return &snapshot;
+}
+
+// reads a requested project or the most recently saved projects into free cache entries, a little bit per loop
+void ProjectPersistence::updatePrefill(Sequencer * sequencer){
+    if (prefillProject < 0){
+        startPrefill(sequencer);
         return;
     }
-    if (file.find("\"global\":")){
-        StaticJsonDocument<200> clockDoc;
-        DeserializationError err = deserializeJson(clockDoc, file);
-        if (err) {
-            Serial.print(F("deserializeJson() returned "));
-            Serial.println(err.c_str());
-            return;
-        }
-        sequencer->clock.setStepLength(clockDoc["stepLength"]);
-        sequencer->clock.setSwing(clockDoc["swing"]);
+    TRACE_EVENT(SD_START, TraceSdOp::PREFILL, prefillProject);
+    JsonParseState state = prefillParser.resume(PREFILL_TIME_BUDGET_MICROS);
+    TRACE_EVENT(SD_END, TraceSdOp::PREFILL, prefillProject);
+    if (state == JsonParseState::PARSING){
+        return;
+    }
+    prefillFile.close();
+    if (state == JsonParseState::DONE){
+        cache.complete(prefillTarget);
     } else {
-        file.seek(0);
-    };
-
-    file.find("\"tracks\":[");
-    int t = 0;
-    int p = 0;
-    int s = 0;
-    do {
-        StaticJsonDocument<48000> trackDoc;
-        DeserializationError err = deserializeJson(trackDoc, file);
-        // Parse succeeded?
-        if (err) {
-            Serial.print(F("deserializeJson() returned "));
-            Serial.println(err.c_str());
-            return;
+        // dont try again until the next save / load
+        cache.remove(prefillTarget);
+        prefillStopped = true;
+        if (pendingProject == prefillProject){
+            Serial.println(loader.hasTooManyLocks() ? F("Too many parameter locks in project file") : F("Failed to parse project file"));
+            pendingProject = -1;
         }
-        sequencer->setChannelGain(t, trackDoc["output1Gain"] | 0.5, trackDoc["output2Gain"] | 0.5);
-        JsonArray patterns = trackDoc["patterns"];
-
-        //Serial.print("track");
-        //Serial.println(t);
-        p = 0;
-        for (JsonObject pattern : patterns){
-            //Serial.print("pattern");
-            //Serial.println(p);
-            SequencerPattern & sequencerPattern = sequencer->tracks[t].patterns[p];
-            sequencerPattern.triggerState = pattern["triggerState"] | 0;
-            sequencerPattern.pLockArmState = pattern["pLockArmState"] | 0;
-            sequencerPattern.offset = pattern["offset"] | 0;
-            sequencerPattern.trackLength = pattern["trackLength"] | 16;
-            sequencerPattern.autoMutate = pattern["autoMutate"] | false;
-            JsonArray steps = pattern["steps"];
-            s = 0;
-            for (JsonObject step : steps){
-                //Serial.print("step ");
-                //Serial.print(s);
-                //Serial.print(":");
-                SequencerStep & sequencerStep = sequencerPattern.steps[s];
-                JsonArray stepParams = step["params"];
-                sequencerStep.triggerMask = step["triggerMask"] | 0b00111111;
-                ParameterSet & params = sequencerStep.params;
-                params.parameter1 = stepParams[0];
-                params.parameter2 = stepParams[1];
-                params.parameter3 = stepParams[2];
-                params.parameter4 = stepParams[3];
-                params.parameter5 = stepParams[4];
-                params.parameter6 = stepParams[5];
-                s++;
+    }
+    prefillProject = -1;
+}
+
+void ProjectPersistence::startPrefill(Sequencer * sequencer){
+    int8_t next = -1;
+    if (pendingProject >= 0 && !isCached(pendingProject)){
+        // a requested project goes first
+        next = pendingProject;
+    } else if (prefillStopped || !cache.hasFreeEntry()){
+        return;
+    } else {
+        for (int i = 0; i < PROJECTSLOTS; i++){
+            uint32_t modification = index.getEntry(i).modification;
+            if (index.exists(i) && !cache.contains(i, modification) &&
+                (next < 0 || modification > index.getEntry(next).modification)){
+                next = i;
             }
-            p++;
         }
-        t++;
-    } while (file.findUntil(",","]"));
+    }
+    if (next >= 0){
+        prefillFile = SD.open(projectFilename(next), FILE_READ);
+    }
+    if (next < 0 || !prefillFile){
+        prefillStopped = true;
+        if (next >= 0 && next == pendingProject){
+            Serial.println(F("Failed to read file"));
+            pendingProject = -1;
+        }
+        return;
+    }
+    prefillTarget = cache.allocate(next, index.getEntry(next).modification);
+    prefillTarget->capture(sequencer);
+    loader.setTarget(prefillTarget, sequencer);
+    prefillParser.begin(prefillFile, loader);
+    prefillProject = next;
+}
 
-    // Close the file
-    file.close();
-    activeProject = 0 | _BV(projectNum);
-    Serial.println(F("Finished load"));
-};
+void ProjectPersistence::cancelPrefill(){
+    if (prefillProject < 0){
+        return;
+    }
+    prefillFile.close();
+    cache.remove(prefillTarget);
+    prefillProject = -1;
+}
+
+boolean ProjectPersistence::isCached(int projectNum){
+    return cache.contains(projectNum, index.getEntry(projectNum).modification);
+}
 
 boolean ProjectPersistence::exists(int projectNum){
-        return existingProjects & _BV(projectNum);
+        return isReady() && index.exists(projectNum);
 };
 
 boolean ProjectPersistence::isActive(int projectNum){
-        return activeProject & _BV(projectNum);
+        return activeProject == projectNum;
 };
 
 
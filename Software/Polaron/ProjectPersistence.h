@@ -1,21 +1,123 @@
 #ifndef ProjectPersistence_h
 #define ProjectPersistence_h
 
+#include <SD.h>
+#include "ProjectIndex.h"
+#include "SessionStore.h"
+#include "SequencerConfig.h"
+
+// max time (in micros) the background save may spend writing per call to update()
+#define SAVE_TIME_BUDGET_MICROS 1000
+#define SD_INIT_ATTEMPTS 4
+#define SD_INIT_RETRY_MILLIS 1000
+// how often the current state is compared to the session in flash (and stored if it changed)
+#define SESSION_AUTOSAVE_MILLIS 30000
+// max time (in micros) spent per call to update() to read projects into the cache
+#define PREFILL_TIME_BUDGET_MICROS 500
+
 class Sequencer;
+class ProjectSnapshot;
 class ProjectPersistence {
    public:
     ProjectPersistence(){};
+    // starts initializing the sd card. this does not block, the card is set up (once the sequencer is stopped) and
+    // the project index is read (in small steps) by the following calls to update(). until then, nothing can be
+    // loaded or saved.
     void init();
-    void save(int projectNum, Sequencer * sequencer);
-    void load(int projectNum, Sequencer * sequencer);
+    // takes a snapshot of the current project and starts writing it to the sd card. The actual writing (opening the
+    // file included) is done in small chunks by update(), so this can be used while the sequencer is running.
+    // returns false if another save is still in progress.
+    bool startSave(int projectNum, Sequencer * sequencer);
+    // continues the sd card initialization, a background save or storing the session (if any).
+    // needs to be called once per loop.
+    void update(Sequencer * sequencer);
+    // restores the state from before the last power cycle (from flash, the sd card is not needed).
+    // returns false if there is no session.
+    bool restoreSession(Sequencer * sequencer);
+    // loads a project into the sequencer. recently used projects are kept in memory and switching to one of them
+    // does not need the sd card.
+    // returns false if the project could not be loaded, or if a save is in progress (see requestLoad()).
+    bool load(int projectNum, Sequencer * sequencer);
+    // prepares a project to be loaded while the sequencer is running. the project is read in the background (if
+    // it is not cached), once isLoadReady() it can be swapped in with finishLoad().
+    bool requestLoad(int projectNum);
+    boolean isLoadPending(int projectNum){return pendingProject >= 0 && pendingProject == projectNum;};
+    boolean isLoadReady();
+    // replaces the sequencer state with the requested project (a memory copy, no sd access)
+    void finishLoad(Sequencer * sequencer);
     boolean exists(int projectNum);
+    // true if the project can be loaded from memory
+    boolean isCached(int projectNum);
     boolean isActive(int projectNum);
+    boolean isReady(){return sdCardInitialized && index.isLoaded();};
+    boolean isSaving(){return savingProject >= 0;};
+    boolean isSaving(int projectNum){return savingProject == projectNum;};
+    // returns how much of the background save is done, scaled to 0..scale
+    uint8_t getSaveProgress(uint8_t scale);
+    // parses a project file into the snapshot of the background save (used by the project benchmark), the sequencer
+    // is not changed. returns NULL if the file can not be read or parsed, or if a save is in progress.
+    ProjectSnapshot * parseFile(const char * filename, Sequencer * sequencer);
    private:
-    void updateProjectList();
+    void initNextAttempt(Sequencer * sequencer);
+    void updateSession(Sequencer * sequencer);
+    ProjectSnapshot * readProject(int projectNum, Sequencer * sequencer);
+    ProjectSnapshot * readProjectFile(int projectNum, Sequencer * sequencer);
+    void applyProject(int projectNum, ProjectSnapshot * project, Sequencer * sequencer);
+    void updatePrefill(Sequencer * sequencer);
+    void startPrefill(Sequencer * sequencer);
+    void cancelPrefill();
+    void writeNextPart();
+    bool isChunkDirty(uint16_t chunk);
+    bool isRecordChanged(uint16_t chunk);
+    bool prepareDeltaSave();
+    uint32_t getRecordEnd();
+    bool writeHeader();
+    void writeLayout();
+    // a pattern record is written in parts (see writeNextPart)
+    void writePatternStart(Print &out, uint8_t track, PatternIndex pattern);
+    void writeStep(Print &out, uint8_t track, PatternIndex pattern, StepIndex step);
+    void writePatternEnd(Print &out, uint8_t track, PatternIndex pattern);
+    void printMask(Print &out, StepMask mask);
+    void failSave();
+    void finishSave();
     boolean sdCardInitialized = false;
-    uint16_t existingProjects = 0;
-    uint16_t activeProject = 0;
+    uint8_t initAttempts = 0;
+    uint32_t nextInitAttempt = 0;
+    ProjectIndex index;
+    int8_t activeProject = -1;
+
+    // state of the background save: the old file is removed (unless it is rewritten in place) and the file is opened,
+    // the records are written, then the file is closed, the index is stored and the snapshot goes into the cache.
+    // each step other than writing takes a call to update() of its own.
+    enum class SaveStep : uint8_t { REMOVE, OPEN, WRITE, CLOSE, STORE_INDEX, CACHE };
+    File saveFile;
+    int8_t savingProject = -1;
+    SaveStep saveStep = SaveStep::REMOVE;
+    uint16_t nextChunk = 0;
+    // the part of the record of nextChunk that is written next (see writeNextPart)
+    uint8_t nextPart = 0;
+    // file position of the record of nextChunk
+    uint32_t recordStart = 0;
+    // true if only the changed records are rewritten
+    bool deltaSave = false;
+    SessionStore session;
+
+    // project requested by requestLoad(), -1 if none
+    int8_t pendingProject = -1;
+
+    // state of the background prefill of the project cache
+    File prefillFile;
+    int8_t prefillProject = -1;
+    // set when there is nothing (more) to prefill
+    bool prefillStopped = false;
+    uint32_t lastSessionCheck = 0;
+    // when the last session store was started, 0 if none
+    uint32_t lastSessionStore = 0;
 
+    // the project whose file matches the sequencer state (except for the parts marked as dirty), -1 if none
+    int8_t syncedProject = -1;
+    // sectors of each pattern record in the file of syncedProject
+    uint8_t syncedLayout[NUMBER_OF_INSTRUMENTTRACKS * NUMBER_OF_PATTERNS];
 };
 
 #endif
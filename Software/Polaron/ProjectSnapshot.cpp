@@ -0,0 +1,132 @@
+#include "ProjectSnapshot.h"
+
+void PatternSnapshot::capture(SequencerPattern &pattern) {
+    triggerState = pattern.triggerState;
+    pLockArmState = pattern.pLockArmState;
+    offset = pattern.offset;
+    trackLength = pattern.trackLength;
+    autoMutate = pattern.autoMutate;
+    dirty = pattern.isDirty();
+    steps = pattern.getSteps();
+}
+
+void PatternSnapshot::apply(SequencerTrack &track, PatternIndex index) {
+    SequencerPattern &pattern = track.patterns[index];
+    pattern.triggerState = triggerState;
+    pattern.pLockArmState = pLockArmState;
+    pattern.offset = offset;
+    pattern.trackLength = trackLength;
+    pattern.autoMutate = autoMutate;
+    if (stepsSource < NUMBER_OF_PATTERNS) {
+        // the source was applied before this pattern
+        pattern.shareSteps(track.patterns[stepsSource]);
+    } else {
+        pattern.setSteps(steps);
+    }
+    pattern.markDirty();
+    pattern.markEdited();
+}
+
+void PatternSnapshot::clear() {
+    triggerState = 0;
+    pLockArmState = 0;
+    offset = 0;
+    trackLength = STEPS_PER_PAGE;
+    autoMutate = false;
+    stepsSource = NUMBER_OF_PATTERNS;
+    for (int s = 0; s < NUMBER_OF_STEPS_PER_PATTERN; s++) {
+        steps.locks[s] = NO_PARAMETER_LOCK;
+    }
+    for (int i = 0; i < TRIGGER_MASK_BITS; i++) {
+        steps.triggerConditions[i] = ~(StepMask)0;
+    }
+}
+
+void TrackSnapshot::clear() {
+    parameters.clear();
+    for (int p = 0; p < NUMBER_OF_PATTERNS; p++) {
+        patterns[p].clear();
+    }
+}
+
+void TrackSnapshot::releaseUnusedLocks() {
+    memset(parameters.refCounts, 0, sizeof(parameters.refCounts));
+    for (int p = 0; p < NUMBER_OF_PATTERNS; p++) {
+        if (patterns[p].stepsSource < NUMBER_OF_PATTERNS) {
+            // one reference per block of step data, the source has it
+            continue;
+        }
+        for (int s = 0; s < NUMBER_OF_STEPS_PER_PATTERN; s++) {
+            parameters.retain(patterns[p].steps.locks[s]);
+        }
+    }
+    for (int l = 0; l < PARAMETER_LOCKS_PER_TRACK; l++) {
+        if (parameters.refCounts[l] == 0) {
+            parameters.masks[l] = 0;
+        }
+    }
+    parameters.full = false;
+}
+
+void ProjectSnapshot::capture(Sequencer *sequencer) {
+    stepLength = sequencer->clock.getStepLength();
+    swing = sequencer->clock.getSwing();
+    clockDirty = sequencer->clock.isDirty();
+    // the live state is not in any file
+    memset(recordSectors, 0, sizeof(recordSectors));
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
+        tracks[t].output1Gain = sequencer->audioChannels[t]->getOutput1Gain();
+        tracks[t].output2Gain = sequencer->audioChannels[t]->getOutput2Gain();
+        tracks[t].settingsDirty = sequencer->tracks[t].isSettingsDirty();
+        tracks[t].parameters = sequencer->tracks[t].parameters;
+        // the first pattern that uses each block of step data
+        PatternIndex blockUsers[STEP_DATA_BLOCKS];
+        for (int b = 0; b < STEP_DATA_BLOCKS; b++) {
+            blockUsers[b] = NUMBER_OF_PATTERNS;
+        }
+        for (int p = 0; p < NUMBER_OF_PATTERNS; p++) {
+            SequencerPattern &pattern = sequencer->tracks[t].patterns[p];
+            tracks[t].patterns[p].capture(pattern);
+            tracks[t].patterns[p].stepsSource = blockUsers[pattern.getStepBlock()];
+            if (blockUsers[pattern.getStepBlock()] == NUMBER_OF_PATTERNS) {
+                blockUsers[pattern.getStepBlock()] = p;
+            }
+        }
+        tracks[t].releaseUnusedLocks();
+    }
+}
+
+void ProjectSnapshot::apply(Sequencer *sequencer) {
+    // the edits refer to the patterns that are replaced
+    sequencer->history.clear();
+    sequencer->clock.setStepLength(stepLength);
+    sequencer->clock.setSwing(swing);
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
+        sequencer->audioChannels[t]->setOutputGains(tracks[t].output1Gain, tracks[t].output2Gain);
+        sequencer->setChannelGain(t, tracks[t].output1Gain, tracks[t].output2Gain);
+        sequencer->tracks[t].parameters = tracks[t].parameters;
+        sequencer->tracks[t].markSettingsDirty();
+        for (int p = 0; p < NUMBER_OF_PATTERNS; p++) {
+            tracks[t].patterns[p].apply(sequencer->tracks[t], p);
+        }
+    }
+}
+
+void ProjectSnapshot::clearDirty() {
+    clockDirty = false;
+    for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
+        tracks[t].settingsDirty = false;
+        for (int p = 0; p < NUMBER_OF_PATTERNS; p++) {
+            tracks[t].patterns[p].dirty = false;
+        }
+    }
+}
+
+bool ProjectSnapshot::hasRecordLayout() {
+    for (int r = 0; r < NUMBER_OF_INSTRUMENTTRACKS * NUMBER_OF_PATTERNS; r++) {
+        if (recordSectors[r] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
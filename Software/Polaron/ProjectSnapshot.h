@@ -0,0 +1,70 @@
+#ifndef ProjectSnapshot_h
+#define ProjectSnapshot_h
+
+#include <inttypes.h>
+#include "Sequencer.h"
+
+/*
+ * A compact copy of everything that is stored in a project file (no step back-pointers, no playback state).
+ * Taking a snapshot is a plain memory copy, so it can be done in between two steps while the sequencer is running.
+ * The background save then serializes from the snapshot instead of the live state.
+ * A snapshot takes about 35 kB with the default dimensions (most of it the lock pools of the tracks, more with longer
+ * patterns), ProjectCache keeps several of them in memory.
+ */
+class PatternSnapshot {
+   public:
+    void capture(SequencerPattern &pattern);
+    // writes the values back into a pattern of a track and marks it as dirty
+    void apply(SequencerTrack &track, PatternIndex index);
+    // sets the values of a new pattern (no triggers, no locks). the locks are not released.
+    void clear();
+
+    StepMask triggerState;
+    StepMask pLockArmState;
+    StepIndex offset;
+    StepIndex trackLength;
+    bool autoMutate;
+    // pattern was changed since the last load / save
+    bool dirty;
+    // an earlier pattern of the track that shares its step data (and the locks in it) with this one, NUMBER_OF_PATTERNS
+    // if the pattern has its own. the sharing is restored by apply(), so the lock references (one per block) match.
+    PatternIndex stepsSource;
+    StepData steps;
+};
+
+class TrackSnapshot {
+   public:
+    float output1Gain;
+    float output2Gain;
+    bool settingsDirty;
+    // base parameters and the locks of all patterns
+    TrackParameters parameters;
+    PatternSnapshot patterns[NUMBER_OF_PATTERNS];
+
+    // clears all patterns and releases all locks (before the track is replaced)
+    void clear();
+    // counts the references of the patterns to the locks and frees the locks no pattern refers to (the ones only
+    // the edit history of the sequencer keeps)
+    void releaseUnusedLocks();
+};
+
+class ProjectSnapshot {
+   public:
+    // copies the project state including the dirty flags (the flags are not cleared)
+    void capture(Sequencer *sequencer);
+    // restores the project state into the sequencer. everything is marked as dirty (there is no file it is in sync with).
+    void apply(Sequencer *sequencer);
+    void clearDirty();
+    // true if the layout of the project file is known (see recordSectors)
+    bool hasRecordLayout();
+
+    uint32_t stepLength;
+    float swing;
+    bool clockDirty;
+    TrackSnapshot tracks[NUMBER_OF_INSTRUMENTTRACKS];
+    // sectors of each pattern record (track by track) in the project file the snapshot was read from or saved to,
+    // 0 if not known (see ProjectPersistence). cleared by capture().
+    uint8_t recordSectors[NUMBER_OF_INSTRUMENTTRACKS * NUMBER_OF_PATTERNS];
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "SectorWriter.h"
+#include "Crc32.h"
+#include "Arduino.h"
+
+bool SectorWriter::begin(File &f, uint32_t position, bool write) {
+    file = &f;
+    sectorPosition = position;
+    bufferLength = 0;
+    writing = write;
+    failed = position % SECTOR_SIZE != 0 || (writing && !file->seek(position));
+    return !failed;
+}
+
+size_t SectorWriter::write(uint8_t b) {
+    buffer[bufferLength++] = b;
+    if (bufferLength == SECTOR_SIZE) {
+        writeSector();
+    }
+    return 1;
+}
+
+size_t SectorWriter::write(const uint8_t *data, size_t size) {
+    size_t remaining = size;
+    while (remaining > 0) {
+        size_t n = SECTOR_SIZE - bufferLength;
+        if (n > remaining) {
+            n = remaining;
+        }
+        memcpy(buffer + bufferLength, data, n);
+        bufferLength += n;
+        data += n;
+        remaining -= n;
+        if (bufferLength == SECTOR_SIZE) {
+            writeSector();
+        }
+    }
+    return size;
+}
+
+bool SectorWriter::padTo(uint32_t position) {
+    if (getPosition() > position) {
+        failed = true;
+        return false;
+    }
+    while (getPosition() < position) {
+        size_t n = SECTOR_SIZE - bufferLength;
+        if (n > position - getPosition()) {
+            n = position - getPosition();
+        }
+        memset(buffer + bufferLength, ' ', n);
+        bufferLength += n;
+        if (bufferLength == SECTOR_SIZE) {
+            writeSector();
+        }
+    }
+    return !failed;
+}
+
+bool SectorWriter::finish() {
+    if (bufferLength > 0) {
+        flush(bufferLength);
+    }
+    return !failed;
+}
+
+bool SectorWriter::writeSector() {
+    return flush(SECTOR_SIZE);
+}
+
+bool SectorWriter::flush(uint16_t length) {
+    crc = crc32(buffer, length, crc);
+    if (writing && file->write(buffer, length) != length) {
+        failed = true;
+    }
+    sectorPosition += length;
+    bufferLength = 0;
+    return !failed;
+}
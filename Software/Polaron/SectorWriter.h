@@ -0,0 +1,51 @@
+#ifndef SectorWriter_h
+#define SectorWriter_h
+
+#include <SD.h>
+
+#define SECTOR_SIZE 512
+
+/*
+ * Buffered output to a file on the sd card. Output is assembled in a sector sized buffer and written to the
+ * card in whole sectors, instead of many small writes. Writing has to start at a sector aligned position,
+ * no memory is allocated.
+ * A crc of everything that passes through the writer is kept, including the output that is only checksummed (see
+ * begin()), so the checksum of a file is known without reading it back.
+ */
+class SectorWriter : public Print {
+   public:
+    SectorWriter(){};
+    // starts writing to file at position (must be a multiple of SECTOR_SIZE). with write = false, the output
+    // only goes into the crc (for parts of the file that are already up to date).
+    bool begin(File &file, uint32_t position, bool write = true);
+    size_t write(uint8_t b);
+    size_t write(const uint8_t *data, size_t size);
+    using Print::write;
+    // fills up with whitespace until position is reached. returns false if more than that was already written.
+    bool padTo(uint32_t position);
+    // writes out the (partially) filled sector. returns false if any of the writes since begin() failed.
+    bool finish();
+    uint32_t getPosition() { return sectorPosition + bufferLength; }
+    // true if any of the writes since begin() failed
+    bool hasFailed() { return failed; }
+    void resetCrc() { crc = 0; }
+    // crc of the output since resetCrc()
+    uint32_t getCrc() { return crc; }
+
+   private:
+    bool writeSector();
+    // checksums the buffer and writes it to the file (if writing)
+    bool flush(uint16_t length);
+
+    File *file = NULL;
+    // file position of the first byte in the buffer
+    uint32_t sectorPosition = 0;
+    uint16_t bufferLength = 0;
+    bool failed = false;
+    bool writing = true;
+    uint32_t crc = 0;
+    // word aligned, so the sd lib can transfer it without copying
+    uint8_t buffer[SECTOR_SIZE] __attribute__((aligned(4)));
+};
+
+#endif
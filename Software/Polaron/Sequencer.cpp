@@ -22,8 +22,12 @@
 
 #include <sstream>
 #include "Sequencer.h"
+#include "LoopProfiler.h"
+#include "Trace.h"
 
 #define MUTE_DIM_FACTOR 20
+// loops a track button flashes red after the track ran out of parameter locks
+#define LOCKS_FULL_FLASH_LOOPS 64
 
 Sequencer::Sequencer() {
     for (int i = 0; i < NUMBER_OF_FUNCTIONBUTTONS; i++) {
@@ -46,7 +50,7 @@ Sequencer::Sequencer() {
     }
 
     for (uint8_t i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        tracks[i].initPatternOpsArmState(i, &patternOpsArmState);
+        tracks[i].initSharedState(i, &patternOpsArmState, &muteState);
     }
 }
 
@@ -54,45 +58,79 @@ Sequencer::Sequencer() {
 * Increments the current step by one on all tracks.
 */
 void Sequencer::doStep() {
+    bool recording = input1.isActive() || input2.isActive() || pLockParamSet == PLockParamSet::SET3_2;
+    if (recording != lockRecording) {
+        // a recording starts (or ends), no step of it is in the history yet
+        lockRecording = recording;
+        for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+            recordedLockSteps[i] = 0;
+        }
+    }
+    // the tracks that trigger on this step
+    TrackMask firingTracks = 0;
     for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        SequencerStep &step = tracks[i].doStep();
+        SequencerStep step = tracks[i].doStep();
         if (step.isParameterLockOn()) {
+            if (recording) {
+                // each step goes into the history once per recording, with its state from before the recording
+                if (recordedLockPatterns[i] != tracks[i].getCurrentPatternIndex()) {
+                    recordedLockPatterns[i] = tracks[i].getCurrentPatternIndex();
+                    recordedLockSteps[i] = 0;
+                }
+                if (!(recordedLockSteps[i] & stepBit(step.getIndex()))) {
+                    recordedLockSteps[i] |= stepBit(step.getIndex());
+                    history.recordStep(tracks[i], tracks[i].getCurrentPatternIndex(), step.getIndex(), false);
+                }
+            }
+            // a lock that can not be created leaves the step unchanged (reported by checkParameterLocks)
+            bool locked = true;
             switch (pLockParamSet) {
                 case PLockParamSet::SET1:
                     if (input1.isActive()) {
-                        step.params.parameter1 = input1.getValue();
+                        locked = step.setParam(0, input1.getValue());
                     }
-                    if (input2.isActive()) {
-                        step.params.parameter2 = input2.getValue();
+                    if (input2.isActive() && locked) {
+                        locked = step.setParam(1, input2.getValue());
                     }
                     break;
                 case PLockParamSet::SET2:
 
                     if (input1.isActive()) {
-                        step.params.parameter3 = input1.getValue();
+                        locked = step.setParam(2, input1.getValue());
                     }
-                    if (input2.isActive()) {
-                        step.params.parameter4 = input2.getValue();
+                    if (input2.isActive() && locked) {
+                        locked = step.setParam(3, input2.getValue());
                     }
                     break;
 
                 case PLockParamSet::SET3:
 
                     if (input1.isActive()) {
-                        step.params.parameter5 = input1.getValue();
+                        locked = step.setParam(4, input1.getValue());
                     }
-                    if (input2.isActive()) {
-                        step.params.parameter6 = input2.getValue();
+                    if (input2.isActive() && locked) {
+                        locked = step.setParam(5, input2.getValue());
                     }
                     break;
 
                 case PLockParamSet::SET3_2:
-                    step.triggerMask = triggerPattern;
+                    step.setTriggerMask(triggerPattern);
                     break;
             }
+            if (recording && locked) {
+                tracks[i].getCurrentPattern().markDirty();
+            }
         }
-        if (!tracks[i].isMuted() && step.isTriggerOn() && step.isTriggerConditionOn()) {
-            ParameterSet & stepParams = step.params;
+        if (tracks[i].isCurrentStepFiring()) {
+            firingTracks |= trackBit(i);
+        }
+    }
+    firingTracks &= ~muteState;
+    static_assert(NUMBER_OF_STEPS_PER_PATTERN <= 256 && NUMBER_OF_INSTRUMENTTRACKS <= 16, "step event does not fit");
+    TRACE_EVENT(STEP, tracks[selectedTrack].getCurrentPattern().getCurrentStepIndex(), firingTracks);
+    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+        if (firingTracks & trackBit(i)) {
+            ParameterSet stepParams = tracks[i].getFiringParams();
             audioChannels[i]->setParam1(stepParams.parameter1);
             audioChannels[i]->setParam2(stepParams.parameter2);
             audioChannels[i]->setParam3(stepParams.parameter3);
@@ -100,6 +138,7 @@ void Sequencer::doStep() {
             audioChannels[i]->setParam5(stepParams.parameter5);
             audioChannels[i]->setParam6(stepParams.parameter6);
 
+            TRACE_EVENT(TRIGGER, i, 0);
             audioChannels[i]->trigger();
             #ifdef SEND_MIDI_OUTPUT
                 usbMIDI.sendControlChange(12, (uint8_t)(stepParams.parameter1 >> 3), i+1);
@@ -171,6 +210,8 @@ void Sequencer::updateState() {
     #endif
 
 
+    checkParameterLocks();
+
     hasActivePLockReceivers = false;
     for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
         if (tracks[i].getCurrentPattern().isInPLockMode()) {
@@ -179,7 +220,12 @@ void Sequencer::updateState() {
         }
     }
 
-    if (functionButtons[BUTTON_SET_PARAMSET_1].rose()) {
+    // with the pattern or the mute button held the param set buttons are part of a combination (load, save, undo,
+    // a/b version) and do not switch the param set
+    bool paramSetCombination = functionButtons[BUTTON_SET_PATTERN].read() || functionButtons[BUTTON_TOGGLE_MUTE].read();
+    if (paramSetCombination) {
+        // the press belongs to the combination
+    } else if (functionButtons[BUTTON_SET_PARAMSET_1].rose()) {
         pLockParamSet = PLockParamSet::SET1;
         deactivateSensors();
     } else if (functionButtons[BUTTON_SET_PARAMSET_2].rose()) {
@@ -201,6 +247,7 @@ void Sequencer::updateState() {
         shiftPressedModeChange = functionMode != FunctionMode::PATTERN_OPS && functionButtons[BUTTON_SET_PATTERN].read();
     }
 
+    LOOP_PROFILE_START_MODE(functionMode);
     switch (functionMode) {
         case FunctionMode::START_STOP:
             doStartStop();
@@ -238,9 +285,25 @@ void Sequencer::updateState() {
         case FunctionMode::LOAD_PROJECT:
             doLoadMode();
             break;
+        case FunctionMode::DEFAULT_MODE:
+            doSetBaseParameters();
+            break;
+        case FunctionMode::UNDO:
+            history.undo();
+            // a recording that goes on records the steps again
+            lockRecording = false;
+            break;
+        case FunctionMode::REDO:
+            history.redo();
+            lockRecording = false;
+            break;
+        case FunctionMode::SWAP_PATTERN_VERSION:
+            history.swapVersion(tracks[selectedTrack], tracks[selectedTrack].getCurrentPatternIndex());
+            break;
         default:
             break;
     }
+    LOOP_PROFILE_STOP_MODE(functionMode);
     if (hasActivePLockReceivers && pLockParamSet == PLockParamSet::SET3_2){
         doSetTriggerConditions();
     } else if (functionMode != FunctionMode::TOGGLE_MUTES && functionMode != FunctionMode::PATTERN_OPS && functionMode != FunctionMode::SET_TEMPO) {
@@ -262,23 +325,47 @@ void Sequencer::updateState() {
     // update clock and see if its time for the next step.
     bool step = clock.update();
     if (step) {
+        TRACE_EVENT(CLOCK, clock.getClockMode(), clock.getStepCount());
         input1.tick();
         input2.tick();
     }
     if (running) {
         // check if we should step (internal clock / midi / triggers etc)
         if (step){
+            LOOP_PROFILE_START(LoopPhase::STEP);
             doStep();
+            LOOP_PROFILE_STOP(LoopPhase::STEP);
+            // a project that was loaded while running replaces the current one once the pattern of the selected track
+            // played its last step, so the next step starts the new project. the playheads stay where they are, like
+            // when switching patterns. the copy is done after the triggers of the step went out, it does not delay them.
+            if (persistence.isLoadReady() && tracks[selectedTrack].getCurrentPattern().isLastStep()) {
+                LOOP_PROFILE_START(LoopPhase::PROJECT_SWAP);
+                persistence.finishLoad(this);
+                LOOP_PROFILE_STOP(LoopPhase::PROJECT_SWAP);
+            }
         }
     }
 
+    clearUnusedTrackLights();
     setFunctionButtonLights();
 
-    // indicate current step
-    if (running) {
-        stepLED(tracks[selectedTrack].getCurrentPattern().getCurrentStepIndex()) = CRGB::Red;
+    // indicate current step (if it is on the page that is shown)
+    uint8_t currentStepIndex = tracks[selectedTrack].getCurrentPattern().getCurrentStepIndex();
+    if (running && currentStepIndex / NUMBER_OF_STEPBUTTONS == editPage) {
+        stepLED(currentStepIndex % NUMBER_OF_STEPBUTTONS) = CRGB::Red;
     }
     previousFunctionMode = functionMode;
+
+    // continue a pending background save, after the step was handled
+    LOOP_PROFILE_START(LoopPhase::PERSISTENCE);
+    persistence.update(this);
+    LOOP_PROFILE_STOP(LoopPhase::PERSISTENCE);
+    if (!running && persistence.isLoadReady()) {
+        // no pattern boundary to wait for
+        LOOP_PROFILE_START(LoopPhase::PROJECT_SWAP);
+        persistence.finishLoad(this);
+        LOOP_PROFILE_STOP(LoopPhase::PROJECT_SWAP);
+    }
 }
 
 FunctionMode Sequencer::calculateFunctionMode() {
@@ -294,10 +381,10 @@ FunctionMode Sequencer::calculateFunctionMode() {
 
     // PATTERN CHANGE OR ENTERING OTHER SHIFT MODES
     if (functionButtons[BUTTON_SET_PATTERN].read()) {
-        if (!running && functionButtons[BUTTON_SET_PARAMSET_1].rose()){
+        if (functionButtons[BUTTON_SET_PARAMSET_1].rose()){
             return FunctionMode::LOAD_PROJECT;
         }
-        if (!running && functionButtons[BUTTON_SET_PARAMSET_2].rose()){
+        if (functionButtons[BUTTON_SET_PARAMSET_2].rose()){
             return FunctionMode::SAVE_PROJECT;
         }
         if (functionButtons[BUTTON_SET_TRACKLENGTH].rose()){
@@ -306,16 +393,22 @@ FunctionMode Sequencer::calculateFunctionMode() {
         if (functionButtons[BUTTON_TOGGLE_PLOCK].rose()) {
             return FunctionMode::TOGGLE_PLOCKS;
         }
+        if (functionButtons[BUTTON_SET_PARAMSET_3].rose()) {
+            return FunctionMode::UNDO;
+        }
+        if (functionButtons[BUTTON_TOGGLE_MUTE].rose()) {
+            return FunctionMode::REDO;
+        }
         if (!shiftPressedModeChange){
             return FunctionMode::PATTERN_OPS;
         }
     }
 
     if (shiftPressedModeChange){
-        if (!running && functionButtons[BUTTON_SET_PARAMSET_1].read()){
+        if (functionButtons[BUTTON_SET_PARAMSET_1].read()){
             return FunctionMode::LOAD_PROJECT;
         }
-        if (!running && functionButtons[BUTTON_SET_PARAMSET_2].read()){
+        if (functionButtons[BUTTON_SET_PARAMSET_2].read()){
             return FunctionMode::SAVE_PROJECT;
         }
         if (functionButtons[BUTTON_SET_TRACKLENGTH].read()){
@@ -334,6 +427,11 @@ FunctionMode Sequencer::calculateFunctionMode() {
         return FunctionMode::LEAVE_TOGGLE_PLOCKS;
     }
 
+    // A/B VERSION OF THE PATTERN
+    if (functionButtons[BUTTON_TOGGLE_MUTE].read() && functionButtons[BUTTON_SET_PARAMSET_3].rose()) {
+        return FunctionMode::SWAP_PATTERN_VERSION;
+    }
+
     // MUTES
     if (functionButtons[BUTTON_TOGGLE_MUTE].read()) {
         return FunctionMode::TOGGLE_MUTES;
@@ -365,9 +463,10 @@ FunctionMode Sequencer::calculateFunctionMode() {
 void Sequencer::doSetTriggers() {
     // value stores if at least one button is pressed down.
     bool aButtonIsPressed = false;
+    SequencerTrack &track = tracks[selectedTrack];
 
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
-        SequencerStep &step = tracks[selectedTrack].getCurrentPattern().getStep(i);
+        SequencerStep step = getEditStep(i);
         if (stepButtons[i].read()) {
             aButtonIsPressed = true;
             if (sourceStepIndex == -1) {
@@ -375,17 +474,22 @@ void Sequencer::doSetTriggers() {
                 // were pressed). Register this step as source for (a possible,
                 // to follow) copy operation.
                 sourceStepIndex = i;
-            } else if (i != sourceStepIndex) {
+            } else if (i != sourceStepIndex && stepButtons[i].rose()) {
                 // this is not the first button that is pressed down, so this is
                 // a target step for copy (from source step)
-                step.copyValuesFrom(tracks[selectedTrack].getCurrentPattern().getStep(sourceStepIndex));
+                history.recordStep(track, track.getCurrentPatternIndex(), step.getIndex(), false);
+                if (step.copyValuesFrom(getEditStep(sourceStepIndex))) {
+                    track.getCurrentPattern().markDirty();
+                }
                 stepCopy = true;
             }
         }
 
         if (stepButtons[i].fell() && !stepCopy) {
             // toggle the step on/off
+            history.recordStep(track, track.getCurrentPatternIndex(), step.getIndex(), false);
             step.toggleTriggerState();
+            track.getCurrentPattern().markDirty();
         }
         stepLED(i) = step.getColor();
     }
@@ -398,28 +502,48 @@ void Sequencer::doSetTriggers() {
 }
 
 /*
- * Set track length mode. Step button presses set the track length. Also handles changing the internal clock tempo and rotating patterns.
+ * Set track length mode. Step button presses set the track length (on the page that is shown). Also handles selecting
+ * the page (input1), rotating patterns (input2) and auto mutate (track buttons).
  */
 void Sequencer::doSetTrackLength() {
+    SequencerPattern &pattern = tracks[selectedTrack].getCurrentPattern();
 
-    functionLED(BUTTON_SET_TRACKLENGTH) = CRGB::CornflowerBlue;
+    if (input1.isActive()) {
+        editPage = (uint32_t)input1.getValue() * NUMBER_OF_PAGES / 1024;
+    }
+    functionLED(BUTTON_SET_TRACKLENGTH) = getPageColor(editPage);
 
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
-        if (stepButtons[i].fell()) {
-            tracks[selectedTrack].getCurrentPattern().trackLength = i + 1;
+        StepIndex length = editPage * NUMBER_OF_STEPBUTTONS + i + 1;
+        if (stepButtons[i].fell() && length != pattern.trackLength) {
+            if (pattern.offset != 0) {
+                // the rotation is applied to the steps (see setTrackLength), which is undone like a pattern copy
+                history.recordPatternCopy(tracks[selectedTrack], tracks[selectedTrack].getCurrentPatternIndex());
+            } else {
+                history.recordPatternSettings(tracks[selectedTrack], tracks[selectedTrack].getCurrentPatternIndex(), true);
+            }
+            pattern.setTrackLength(length);
         }
-        stepLED(i) = tracks[selectedTrack].getCurrentPattern().getStep(i).getColor();
+        stepLED(i) = getEditStep(i).getColor();
+    }
+    if ((pattern.trackLength - 1) / NUMBER_OF_STEPBUTTONS == editPage) {
+        stepLED((pattern.trackLength - 1) % NUMBER_OF_STEPBUTTONS) = CRGB::Red;
     }
-    stepLED(tracks[selectedTrack].getCurrentPattern().trackLength - 1) = CRGB::Red;
-
 
     if (input2.isActive()) {
-        tracks[selectedTrack].getCurrentPattern().rotate(16 - (input2.getValue() / 64));
+        StepIndex offset = (pattern.trackLength - (input2.getValue() * pattern.trackLength / 1024)) % pattern.trackLength;
+        if (offset != pattern.offset) {
+            history.recordPatternSettings(tracks[selectedTrack], tracks[selectedTrack].getCurrentPatternIndex(), true);
+            pattern.rotate(offset);
+        }
     }
 
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        if (trackButtons[i].fell()) {
-            tracks[i].getCurrentPattern().autoMutate = !tracks[i].getCurrentPattern().autoMutate;
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        uint8_t t = getPageTrack(i);
+        if (t < NUMBER_OF_INSTRUMENTTRACKS && trackButtons[i].fell()) {
+            history.recordPatternSettings(tracks[t], tracks[t].getCurrentPatternIndex(), false);
+            tracks[t].getCurrentPattern().autoMutate = !tracks[t].getCurrentPattern().autoMutate;
+            tracks[t].getCurrentPattern().markDirty();
         }
     }
 }
@@ -432,18 +556,22 @@ void Sequencer::doLeaveSetTrackLength(){
  */
 void Sequencer::doSetTrackPLock() {
     functionLED(BUTTON_TOGGLE_PLOCK) = CRGB::DarkOrange;
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        if (trackButtons[i].fell()) {
-            tracks[i].getCurrentPattern().togglePLockMode();
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        uint8_t t = getPageTrack(i);
+        if (t < NUMBER_OF_INSTRUMENTTRACKS && trackButtons[i].fell()) {
+            history.recordPatternSettings(tracks[t], tracks[t].getCurrentPatternIndex(), false);
+            tracks[t].getCurrentPattern().togglePLockMode();
             trackOrStepButtonPressed = true;
         }
     }
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
         if (stepButtons[i].fell()) {
-            tracks[selectedTrack].getCurrentPattern().getStep(i).toggleParameterLockRecord();
+            history.recordStep(tracks[selectedTrack], tracks[selectedTrack].getCurrentPatternIndex(), getEditStep(i).getIndex(), false);
+            getEditStep(i).toggleParameterLockRecord();
+            tracks[selectedTrack].getCurrentPattern().markDirty();
             trackOrStepButtonPressed = true;
         }
-        stepLED(i) = tracks[selectedTrack].getCurrentPattern().getStep(i).getColor();
+        stepLED(i) = getEditStep(i).getColor();
     }
     if (functionButtons[BUTTON_TOGGLE_PLOCK].rose()) {
         trackOrStepButtonPressed = false;
@@ -452,22 +580,24 @@ void Sequencer::doSetTrackPLock() {
 
 void Sequencer::doToggleTrackMuteArm() {
     functionLED(BUTTON_TOGGLE_MUTE) = CRGB::CornflowerBlue;
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        if (trackButtons[i].fell()) {
-            tracks[i].toggleMuteArm();
-        }
-    }
     ledFader++;
     if (ledFader > 200) ledFader = 10;
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        if (!tracks[i].isMuted() && tracks[i].isArmed()) {
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        uint8_t t = getPageTrack(i);
+        if (t >= NUMBER_OF_INSTRUMENTTRACKS) {
+            break;
+        }
+        if (trackButtons[i].fell()) {
+            tracks[t].toggleMuteArm();
+        }
+        if (!tracks[t].isMuted() && tracks[t].isArmed()) {
             trackLED(i) = CRGB::CornflowerBlue;
             trackLED(i).nscale8(255 - ledFader);
-        } else if (tracks[i].isMuted() && tracks[i].isArmed()) {
+        } else if (tracks[t].isMuted() && tracks[t].isArmed()) {
             trackLED(i) = CRGB::CornflowerBlue;
             trackLED(i).nscale8(ledFader);
         } else {
-            setDefaultTrackLight(i);
+            setDefaultTrackLight(t);
         }
     }
 }
@@ -476,66 +606,82 @@ void Sequencer::doToggleTrackMuteArm() {
  * Pattern Ops: Operations related to patterns: arm / dearm switching patterns / copy paste.
  */
 void Sequencer::doPatternOps() {
-    functionLED(BUTTON_SET_PATTERN) = CRGB::CornflowerBlue;
+    // with more patterns / tracks than buttons, input1 selects the page of patterns, input2 the page of tracks
+    if (NUMBER_OF_PATTERNPAGES > 1 && input1.isActive()) {
+        patternPage = (uint32_t)input1.getValue() * NUMBER_OF_PATTERNPAGES / 1024;
+    }
+    if (NUMBER_OF_TRACKPAGES > 1 && input2.isActive()) {
+        trackPage = (uint32_t)input2.getValue() * NUMBER_OF_TRACKPAGES / 1024;
+    }
+    functionLED(BUTTON_SET_PATTERN) = getPageColor(patternPage);
     ledFader++;
     if (ledFader > 200) ledFader = 10;
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        uint8_t t = getPageTrack(i);
+        if (t >= NUMBER_OF_INSTRUMENTTRACKS) {
+            break;
+        }
         if (trackButtons[i].fell()) {
-            tracks[i].togglePatternOpsArm();
+            tracks[t].togglePatternOpsArm();
         }
-        if (tracks[i].isPatternOpsArmed()) {
+        if (tracks[t].isPatternOpsArmed()) {
             trackLED(i) = CRGB::CornflowerBlue;
             trackLED(i).nscale8(255 - ledFader);
         } else {
-            setDefaultTrackLight(i);
+            setDefaultTrackLight(t);
         }
     }
 
-    uint8_t currentPatternIndex = tracks[selectedTrack].getCurrentPatternIndex();
+    PatternIndex currentPatternIndex = tracks[selectedTrack].getCurrentPatternIndex();
     bool aButtonIsPressed = false;
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
+        PatternIndex p = patternPage * NUMBER_OF_STEPBUTTONS + i;
+        if (p >= NUMBER_OF_PATTERNS) {
+            stepLED(i) = CRGB::Black;
+            continue;
+        }
         if (stepButtons[i].read()) {
             aButtonIsPressed = true;
-            if (sourcePatternIndex == -1) {
+            if (sourcePatternIndex == NUMBER_OF_PATTERNS) {
                 // this is the first button that is pressed down (after no steps
-                // were pressed). Register this step as source for (a possible,
+                // were pressed). Register this pattern as source for (a possible,
                 // to follow) copy operation.
-                sourcePatternIndex = i;
-            } else if (i != sourcePatternIndex) {
+                sourcePatternIndex = p;
+            } else if (p != sourcePatternIndex && stepButtons[i].rose()) {
                 // this is not the first button that is pressed down, so this is
-                // a target step for copy (from source step)
+                // a target pattern for copy (from source pattern, which may be on another page)
                 for (auto &track : tracks) {
                     if (!anyPatternOpsArmed() || track.isPatternOpsArmed()) {
-                        track.patterns[i].copyValuesFrom(track.patterns[sourcePatternIndex]);
-                        stepLED(i) = CRGB::Red;
+                        history.recordPatternCopy(track, p);
+                        track.patterns[p].copyValuesFrom(track.patterns[sourcePatternIndex]);
                     }
                 }
                 patternCopy = true;
             }
         }
         if (stepButtons[i].fell() && !patternCopy) {
-            nextPatternIndex = i;
+            nextPatternIndex = p;
         }
 
         boolean patternUsed = false;
         for (int t = 0; t < NUMBER_OF_INSTRUMENTTRACKS; t++) {
-            if (tracks[t].patterns[i].triggerState > 0){
+            if (tracks[t].patterns[p].triggerState > 0){
                 patternUsed = true;
                 break;
             }
         }
 
-        stepLED(i) = (i == currentPatternIndex) ? CRGB::Red : patternUsed ? CRGB::Yellow : CRGB::Black;
+        stepLED(i) = (p == currentPatternIndex) ? CRGB::Red : patternUsed ? CRGB::Yellow : CRGB::Black;
     }
     if (!aButtonIsPressed) {
         // reset values needed for the copy operation as soon as no step buttons
         // are pressed at all
-        sourcePatternIndex = -1;
+        sourcePatternIndex = NUMBER_OF_PATTERNS;
         patternCopy = false;
     }
-    if (nextPatternIndex >= 0) {
-        stepLED(nextPatternIndex) = CRGB::Red;
-        stepLED(nextPatternIndex).nscale8(255 - ledFader);
+    if (nextPatternIndex < NUMBER_OF_PATTERNS && nextPatternIndex / NUMBER_OF_STEPBUTTONS == patternPage) {
+        stepLED(nextPatternIndex % NUMBER_OF_STEPBUTTONS) = CRGB::Red;
+        stepLED(nextPatternIndex % NUMBER_OF_STEPBUTTONS).nscale8(255 - ledFader);
     }
 }
 
@@ -544,7 +690,7 @@ void Sequencer::doPatternOps() {
  */
 void Sequencer::doLeavePatternOps() {
     for (auto &track : tracks) {
-        if (nextPatternIndex >= 0) {
+        if (nextPatternIndex < NUMBER_OF_PATTERNS) {
             if (!anyPatternOpsArmed()) {
                 // the general, non-track specific pattern change, will also unmute all tracks
                 track.unMute();
@@ -555,14 +701,14 @@ void Sequencer::doLeavePatternOps() {
         }
     }
     deactivateAllPatternOpsArms();
-    nextPatternIndex = -1;
+    nextPatternIndex = NUMBER_OF_PATTERNS;
 }
 
 void Sequencer::doSetTriggerConditions(){
     trackLED(0) = CRGB::Black;
     trackLED(1) = CRGB::Black;
-    for (int i = 2; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        int idx = NUMBER_OF_INSTRUMENTTRACKS - i - 1;
+    for (int i = 2; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        int idx = NUMBER_OF_TRACKBUTTONS - i - 1;
         if (trackButtons[i].rose()){
             triggerPattern ^= _BV(idx);
         }
@@ -572,26 +718,59 @@ void Sequencer::doSetTriggerConditions(){
 }
 
 void Sequencer::doSetTrackSelection() {
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
+        uint8_t t = getPageTrack(i);
+        if (t >= NUMBER_OF_INSTRUMENTTRACKS) {
+            break;
+        }
         if (trackButtons[i].rose()) {
             deactivateSensors();
-            selectedTrack = i;
+            selectedTrack = t;
         }
-        setDefaultTrackLight(i);
+        setDefaultTrackLight(t);
         // while trackbuttons are pressed, input1 changes the volume of the track, input2 the panorama (only when not in plock mode)
         if (!hasActivePLockReceivers && trackButtons[i].read()) {
             if (input1.isActive()) {
-                audioChannels[i]->setVolume(input1.getValue());
-                setChannelGain(i, audioChannels[i]->getOutput1Gain(), audioChannels[i]->getOutput2Gain());
+                audioChannels[t]->setVolume(input1.getValue());
+                setChannelGain(t, audioChannels[t]->getOutput1Gain(), audioChannels[t]->getOutput2Gain());
+                tracks[t].markSettingsDirty();
             }
             if (input2.isActive()) {
-                audioChannels[i]->setPan(input2.getValue());
-                setChannelGain(i, audioChannels[i]->getOutput1Gain(), audioChannels[i]->getOutput2Gain());
+                audioChannels[t]->setPan(input2.getValue());
+                setChannelGain(t, audioChannels[t]->getOutput1Gain(), audioChannels[t]->getOutput2Gain());
+                tracks[t].markSettingsDirty();
             }
         }
     }
 }
 
+/*
+ * Without plock receivers, the pots change the base parameters (of the selected param set) of the selected track.
+ * Steps that lock a parameter keep their own value.
+ */
+void Sequencer::doSetBaseParameters() {
+    if (hasActivePLockReceivers) {
+        return;
+    }
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS && getPageTrack(i) < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+        if (trackButtons[i].read()) {
+            // volume / panorama, see doSetTrackSelection()
+            return;
+        }
+    }
+    uint8_t offset = pLockParamSet == PLockParamSet::SET1 ? 0 : pLockParamSet == PLockParamSet::SET2 ? 2 : 4;
+    SequencerTrack &track = tracks[selectedTrack];
+    // a pot that is active but not moved is not an edit
+    if (input1.isActive() && track.getBaseParameter(offset) != clampParameter(input1.getValue())) {
+        history.recordBaseParameter(track, offset);
+        track.setBaseParameter(offset, input1.getValue());
+    }
+    if (input2.isActive() && track.getBaseParameter(offset + 1) != clampParameter(input2.getValue())) {
+        history.recordBaseParameter(track, offset + 1);
+        track.setBaseParameter(offset + 1, input2.getValue());
+    }
+}
+
 void Sequencer::doSetTempo(){
     functionLED(BUTTON_SET_PATTERN) = CRGB::DarkOrange;
     functionLED(BUTTON_SET_TRACKLENGTH) = CRGB::DarkOrange;
@@ -611,7 +790,7 @@ void Sequencer::doSetTempo(){
         clock.setSwing(0.50 * input2.getValue() / 1024.0);
         functionLED(BUTTON_TOGGLE_PLOCK) = CRGB::Red;
     }
-    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+    for (int i = 0; i < NUMBER_OF_TRACKBUTTONS; i++) {
         if (trackButtons[i].rose()){
             clock.changeStepLength(buttonTempoChangeMap[i]);
             buttonTempoFlashMap[i] = 32;
@@ -626,27 +805,60 @@ void Sequencer::doSetTempo(){
     }
 }
 
+/*
+ * Save mode: a step button press starts a background save to the corresponding slot. While the save is in progress,
+ * the step leds show a progress bar and the target slot flashes.
+ */
 void Sequencer::doSaveMode(){
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++){
         if (stepButtons[i].rose()){
-            persistence.save(i, this);
+            persistence.startSave(i, this);
             return;
         }
     }
+    ledFader++;
+    if (ledFader > 200) ledFader = 10;
+    uint8_t progress = persistence.getSaveProgress(NUMBER_OF_STEPBUTTONS);
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
-        stepLED(i) = persistence.isActive(i) ? CRGB::Red : persistence.exists(i) ? CRGB::Yellow : CRGB::Black;
+        if (persistence.isSaving(i)){
+            stepLED(i) = CRGB::Red;
+            stepLED(i).nscale8(255 - ledFader);
+        } else if (persistence.isSaving()){
+            stepLED(i) = i < progress ? CRGB::DarkOrange : CRGB::Black;
+        } else {
+            stepLED(i) = persistence.isActive(i) ? CRGB::Red : persistence.exists(i) ? CRGB::Yellow : CRGB::Black;
+        }
     }
-    //stepLED(persistence.i)
 };
-void Sequencer::doLoadMode(){    
+/*
+ * Load mode: a step button press loads the corresponding project. While running (or saving), the project is prepared
+ * in the background and takes over at the end of the current pattern, the slot flashes until then.
+ */
+void Sequencer::doLoadMode(){
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++){
         if (stepButtons[i].rose()){
-            persistence.load(i, this);
+            if (running || persistence.isSaving()){
+                // the project is read after the save and replaces the current one once it is ready
+                persistence.requestLoad(i);
+            } else {
+                persistence.load(i, this);
+            }
             return;
         }
     }
+    ledFader++;
+    if (ledFader > 200) ledFader = 10;
+    // cached projects (green) are loaded instantly, the others (yellow) are read from the sd card
     for (int i = 0; i < NUMBER_OF_STEPBUTTONS; i++) {
-        stepLED(i) = persistence.isActive(i) ? CRGB::Red : persistence.exists(i) ? CRGB::Yellow : CRGB::Black;
+        if (persistence.isLoadPending(i)){
+            stepLED(i) = CRGB::Green;
+            stepLED(i).nscale8(255 - ledFader);
+            continue;
+        }
+        stepLED(i) = persistence.isActive(i)   ? CRGB::Red
+                     : persistence.isCached(i) ? CRGB::Green
+                     : persistence.exists(i)   ? CRGB::Yellow
+                                               : CRGB::Black;
     }
 };
 
@@ -658,7 +870,10 @@ void Sequencer::doUpdateMutes() {
 
 void Sequencer::doTurnOffPlockMode() {
     for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-        tracks[i].getCurrentPattern().turnOffPLockMode();
+        if (tracks[i].getCurrentPattern().isInPLockMode()) {
+            history.recordPatternSettings(tracks[i], tracks[i].getCurrentPatternIndex(), false);
+            tracks[i].getCurrentPattern().turnOffPLockMode();
+        }
     }
     if (pLockParamSet == PLockParamSet::SET3_2){
         pLockParamSet = PLockParamSet::SET3;
@@ -666,19 +881,63 @@ void Sequencer::doTurnOffPlockMode() {
 }
 
 void Sequencer::setDefaultTrackLight(uint8_t trackNum) {
+    // the track is on the page that is shown
+    CRGB &led = trackLED(trackNum % NUMBER_OF_TRACKBUTTONS);
     if (tracks[trackNum].getCurrentPattern().isInPLockMode()) {
         hasActivePLockReceivers = true;
         // if track is recording plocks
-        trackLED(trackNum) = (trackNum == selectedTrack) ? CRGB::DarkOrange : CRGB::Yellow;
+        led = (trackNum == selectedTrack) ? CRGB::DarkOrange : CRGB::Yellow;
     } else {
-        trackLED(trackNum) = (trackNum == selectedTrack) ? CRGB::Green : CRGB::CornflowerBlue;
+        led = (trackNum == selectedTrack) ? CRGB::Green : CRGB::CornflowerBlue;
     }
     if (tracks[trackNum].isMuted()) {
-        trackLED(trackNum).nscale8(MUTE_DIM_FACTOR);
+        led.nscale8(MUTE_DIM_FACTOR);
+    }
+    if (lockFullFlashMap[trackNum] > 0) {
+        led = CRGB::Red;
     }
 }
 
+/*
+ * Reports the tracks that ran out of parameter locks: an edit that needed a new lock (recording, step copy, undo) was
+ * not done. The track button flashes red for a while.
+ */
+void Sequencer::checkParameterLocks() {
+    for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
+        if (tracks[i].parameters.checkFull()) {
+            if (lockFullFlashMap[i] == 0) {
+                Serial.print(F("Track "));
+                Serial.print(i);
+                Serial.println(F(" has no free parameter locks left"));
+            }
+            lockFullFlashMap[i] = LOCKS_FULL_FLASH_LOOPS;
+        } else if (lockFullFlashMap[i] > 0) {
+            lockFullFlashMap[i]--;
+        }
+    }
+}
+
+// the track buttons after the last track (on its page) are dark
+void Sequencer::clearUnusedTrackLights() {
+    for (int i = NUMBER_OF_TRACKBUTTONS - 1; i >= 0 && getPageTrack(i) >= NUMBER_OF_INSTRUMENTTRACKS; i--) {
+        trackLED(i) = CRGB::Black;
+    }
+}
+
+CRGB Sequencer::getPageColor(uint8_t page) {
+    static const uint32_t pageColors[] = {CRGB::CornflowerBlue, CRGB::Green, CRGB::Yellow, CRGB::DarkOrange};
+    return pageColors[page % 4];
+}
+
 void Sequencer::setFunctionButtonLights() {
+    if (editPage > 0 && functionMode == FunctionMode::DEFAULT_MODE) {
+        // steps are edited on another page than the first
+        functionLED(BUTTON_SET_TRACKLENGTH) = getPageColor(editPage);
+    }
+    if (trackPage > 0 && functionMode == FunctionMode::DEFAULT_MODE) {
+        // the track buttons show another page of tracks than the first
+        functionLED(BUTTON_SET_PATTERN) = getPageColor(trackPage);
+    }
     functionLED(BUTTON_STARTSTOP) = running ? CRGB::Green : clock.getClockMode() == ClockMode::TRIGGER ? CRGB::CornflowerBlue : ((clock.getStepCount() >> 1) % 2 == 0 ? CRGB::Black : CRGB::Green);
     if (hasActivePLockReceivers) {
         if (input1.isActive() || input2.isActive()){
@@ -688,13 +947,14 @@ void Sequencer::setFunctionButtonLights() {
         }
     }
     functionLED(BUTTON_SET_PARAMSET_1) = pLockParamSet == PLockParamSet::SET1 ? CRGB::Green : CRGB::CornflowerBlue;
-    functionLED(BUTTON_SET_PARAMSET_2) = pLockParamSet == PLockParamSet::SET2 ? CRGB::Green : CRGB::CornflowerBlue;
+    functionLED(BUTTON_SET_PARAMSET_2) = persistence.isSaving() ? CRGB::Red : pLockParamSet == PLockParamSet::SET2 ? CRGB::Green : CRGB::CornflowerBlue;
     functionLED(BUTTON_SET_PARAMSET_3) = pLockParamSet == PLockParamSet::SET3 ? CRGB::Green : 
         pLockParamSet == PLockParamSet::SET3_2 ? CRGB::DarkBlue : CRGB::CornflowerBlue;
 }
 
 
 void Sequencer::onMidiInput(uint8_t rtb) {
+    TRACE_EVENT(MIDI_REALTIME, rtb, 0);
     switch (rtb) {
         case 248:  // Clock
             clock.notifyMidiClockReceived();
@@ -30,8 +30,9 @@
 #include "FastLED.h"
 #include "Sensor.h"
 #include "SequencerTrack.h"
-#include "mixer.h"
+#include "MixerBus.h"
 #include "Clock.h"
+#include "EditHistory.h"
 #include "ProjectPersistence.h"
 
 #define SHIFT_IN_DATA_PIN 1
@@ -40,10 +41,15 @@
 #define POTI_PIN_1 A8
 #define POTI_PIN_2 A9
 
-#define NUMBER_OF_INSTRUMENTTRACKS 6
+// the number of tracks / steps / patterns is set in SequencerConfig.h, the buttons are given by the hardware
 #define NUMBER_OF_FUNCTIONBUTTONS 8
 #define NUMBER_OF_TRACKBUTTONS 6
-#define NUMBER_OF_STEPBUTTONS 16
+#define NUMBER_OF_STEPBUTTONS STEPS_PER_PAGE
+
+// steps, tracks and patterns are shown page by page on their buttons
+static_assert(NUMBER_OF_STEPS_PER_PATTERN % NUMBER_OF_STEPBUTTONS == 0, "steps per pattern must be whole pages");
+#define NUMBER_OF_TRACKPAGES ((NUMBER_OF_INSTRUMENTTRACKS + NUMBER_OF_TRACKBUTTONS - 1) / NUMBER_OF_TRACKBUTTONS)
+#define NUMBER_OF_PATTERNPAGES ((NUMBER_OF_PATTERNS + NUMBER_OF_STEPBUTTONS - 1) / NUMBER_OF_STEPBUTTONS)
 
 #define BUTTON_STARTSTOP 0
 #define BUTTON_TOGGLE_PLOCK 1
@@ -77,7 +83,10 @@ enum class FunctionMode {
     SET_TEMPO,
     DEFAULT_MODE,
     LOAD_PROJECT,
-    SAVE_PROJECT
+    SAVE_PROJECT,
+    UNDO,
+    REDO,
+    SWAP_PATTERN_VERSION
 };
 enum class PLockParamSet { SET1, SET2, SET3, SET3_2 };
 
@@ -93,6 +102,7 @@ class Sequencer {
     Sensor input2;
 
     ProjectPersistence persistence;
+    EditHistory history;
 
     // All leds are in the same array, since i could not get the lib to work
     // with several arrays.
@@ -101,19 +111,19 @@ class Sequencer {
     // main method. after reading inputs, this will update the state of the sequencer
     void updateState();
 
-    // sets two 8 channel mixer objects. these are needed in order to be able to control gain / panorama of all AudioChannels
-    void setMixers(AudioMixer8 *mix1, AudioMixer8 *mix2) {
-        mixerL = mix1;
-        mixerR = mix2;
+    // sets the mixer buses of both outputs. these are needed in order to be able to control gain / panorama of all AudioChannels
+    void setMixers(MixerBus *busL, MixerBus *busR) {
+        mixerL = busL;
+        mixerR = busR;
         for (int i = 0; i < NUMBER_OF_INSTRUMENTTRACKS; i++) {
-            mixerL->gain(i, audioChannels[i]->getOutput1Gain());
-            mixerR->gain(i, audioChannels[i]->getOutput2Gain());
+            mixerL->setTrackGain(i, audioChannels[i]->getOutput1Gain());
+            mixerR->setTrackGain(i, audioChannels[i]->getOutput2Gain());
         }
     }
 
     void setChannelGain(uint8_t channel, float output1Gain, float output2Gain){
-        mixerL->gain(channel, output1Gain);
-        mixerR->gain(channel, output2Gain);
+        mixerL->setTrackGain(channel, output1Gain);
+        mixerR->setTrackGain(channel, output2Gain);
     }
 
     void onMidiInput(uint8_t rtb);
@@ -126,29 +136,43 @@ class Sequencer {
    private:
     PLockParamSet pLockParamSet = PLockParamSet::SET1;
 
-    AudioMixer8 *mixerL;
-    AudioMixer8 *mixerR;
+    // live recording of parameter locks: the steps (of the pattern in recordedLockPatterns) that are already in the
+    // history, so the step hot path only tests a bit instead of searching the history
+    bool lockRecording = false;
+    StepMask recordedLockSteps[NUMBER_OF_INSTRUMENTTRACKS] = {};
+    PatternIndex recordedLockPatterns[NUMBER_OF_INSTRUMENTTRACKS] = {};
+
+    MixerBus *mixerL;
+    MixerBus *mixerR;
 
     // defines the tempochanges in percent when using the track buttons to adjust the tempochanges
-    const float buttonTempoChangeMap[6] = {1.1,1.01,1.001,0.999,0.99,0.9};
+    const float buttonTempoChangeMap[NUMBER_OF_TRACKBUTTONS] = {1.1,1.01,1.001,0.999,0.99,0.9};
     // counters used to track led button flashing 
-    int8_t buttonTempoFlashMap[6] = {0,0,0,0,0,0};
+    int8_t buttonTempoFlashMap[NUMBER_OF_TRACKBUTTONS] = {0,0,0,0,0,0};
+    // counters of the red flash of the tracks that ran out of parameter locks
+    uint8_t lockFullFlashMap[NUMBER_OF_INSTRUMENTTRACKS] = {};
     // counters used to track the note-off signal after note-on 
-    int8_t triggers[6] = {0,0,0,0,0,0};
+    int8_t triggers[NUMBER_OF_INSTRUMENTTRACKS] = {};
     
     uint8_t selectedTrack = 0;
+    // the page of steps shown on the step buttons
+    uint8_t editPage = 0;
+    // the page of tracks shown on the track buttons, the page of patterns shown on the step buttons in pattern ops
+    uint8_t trackPage = 0;
+    uint8_t patternPage = 0;
     uint8_t ledFader = 0;
 
-    uint8_t patternOpsArmState = 0;
+    TrackMask patternOpsArmState = 0;
+    TrackMask muteState = 0;
     uint8_t triggerPattern = 0;
 
     // tracks state of step copy operation
     int8_t sourceStepIndex = -1;
     bool stepCopy = false;
 
-    // tracks state of pattern copy operation
-    int8_t sourcePatternIndex = -1;
-    int8_t nextPatternIndex = -1;
+    // tracks state of pattern copy operation (NUMBER_OF_PATTERNS: none)
+    PatternIndex sourcePatternIndex = NUMBER_OF_PATTERNS;
+    PatternIndex nextPatternIndex = NUMBER_OF_PATTERNS;
 
     bool patternCopy = false;
     bool hasActivePLockReceivers = false;
@@ -177,10 +201,20 @@ class Sequencer {
     void doPatternOps();
     void doLeavePatternOps();
     void doSetTempo();
+    void doSetBaseParameters();
+    // returns the step of the selected track shown on a step button
+    SequencerStep getEditStep(uint8_t button) {
+        return tracks[selectedTrack].getCurrentPattern().getStep(editPage * NUMBER_OF_STEPBUTTONS + button);
+    }
+    CRGB getPageColor(uint8_t page);
+    // returns the track shown on a track button, NUMBER_OF_INSTRUMENTTRACKS or more if the button has no track
+    uint8_t getPageTrack(uint8_t button) { return trackPage * NUMBER_OF_TRACKBUTTONS + button; }
+    void clearUnusedTrackLights();
     void doSaveMode();
     void doLoadMode();
 
     void setDefaultTrackLight(uint8_t trackNum);
+    void checkParameterLocks();
     void setFunctionButtonLights();
 
     void start();
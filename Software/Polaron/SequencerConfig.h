@@ -0,0 +1,63 @@
+#ifndef SequencerConfig_h
+#define SequencerConfig_h
+
+#include <inttypes.h>
+
+// Dimensions of the sequencer. The defaults match the hardware, other builds can override them with compiler flags
+// (e.g. -DNUMBER_OF_PATTERNS=32). Everything else (mask types, file layout, loops) is derived from these values at
+// compile time.
+#ifndef NUMBER_OF_INSTRUMENTTRACKS
+#define NUMBER_OF_INSTRUMENTTRACKS 6
+#endif
+#ifndef NUMBER_OF_STEPS_PER_PATTERN
+#define NUMBER_OF_STEPS_PER_PATTERN 64
+#endif
+#ifndef NUMBER_OF_PATTERNS
+#define NUMBER_OF_PATTERNS 16
+#endif
+
+// the steps of a pattern are edited page by page on the step buttons
+#define STEPS_PER_PAGE 16
+#define NUMBER_OF_PAGES ((NUMBER_OF_STEPS_PER_PATTERN + STEPS_PER_PAGE - 1) / STEPS_PER_PAGE)
+
+// the smallest unsigned type with (at least) the given number of bits
+template <int bits, bool fits8 = (bits <= 8), bool fits16 = (bits <= 16), bool fits32 = (bits <= 32)>
+class BitMask {
+   public:
+    typedef uint64_t type;
+};
+template <int bits>
+class BitMask<bits, true, true, true> {
+   public:
+    typedef uint8_t type;
+};
+template <int bits>
+class BitMask<bits, false, true, true> {
+   public:
+    typedef uint16_t type;
+};
+template <int bits>
+class BitMask<bits, false, false, true> {
+   public:
+    typedef uint32_t type;
+};
+
+static_assert(NUMBER_OF_STEPS_PER_PATTERN <= 64 && NUMBER_OF_INSTRUMENTTRACKS <= 64, "too many steps / tracks for a mask");
+
+// one bit per step of a pattern (trigger state, plock arm state)
+typedef BitMask<NUMBER_OF_STEPS_PER_PATTERN>::type StepMask;
+// one bit per track (pattern ops arm state)
+typedef BitMask<NUMBER_OF_INSTRUMENTTRACKS>::type TrackMask;
+
+// number of bits needed for values up to max
+constexpr int bitsFor(uint32_t max) { return max > 1 ? 1 + bitsFor(max >> 1) : 1; }
+
+// a pattern number, NUMBER_OF_PATTERNS is used for "no pattern"
+typedef BitMask<bitsFor(NUMBER_OF_PATTERNS)>::type PatternIndex;
+// a step number or a number of steps within a pattern (playhead, track length, rotation)
+typedef BitMask<bitsFor(NUMBER_OF_STEPS_PER_PATTERN)>::type StepIndex;
+
+inline StepMask stepBit(uint8_t step) { return (StepMask)1 << step; }
+inline TrackMask trackBit(uint8_t track) { return (TrackMask)1 << track; }
+
+#endif
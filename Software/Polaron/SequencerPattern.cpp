@@ -22,39 +22,167 @@
 
 #include "SequencerPattern.h"
 
-SequencerPattern::SequencerPattern() : trackLength(NUMBER_OF_STEPS_PER_PATTERN) {}
+// new patterns are one page long
+SequencerPattern::SequencerPattern() : trackLength(STEPS_PER_PAGE) {}
 
-void SequencerPattern::init(ParameterSet defaultValues) {
+void StepDataPool::init() {
+    for (int i = 0; i < STEP_DATA_BLOCKS; i++) {
+        refCounts[i] = 0;
+    }
+}
+
+StepBlockIndex StepDataPool::allocate() {
+    for (int i = 0; i < STEP_DATA_BLOCKS; i++) {
+        if (refCounts[i] == 0) {
+            refCounts[i] = 1;
+            return i;
+        }
+    }
+    // can not happen, there is a block for every reference
+    return 0;
+}
+
+void SequencerPattern::init(TrackParameters *trackParameters, StepDataPool *stepDataPool) {
+    parameters = trackParameters;
+    stepPool = stepDataPool;
+    stepBlock = stepPool->allocate();
+    StepData &steps = stepPool->blocks[stepBlock];
     for (int i = 0; i < NUMBER_OF_STEPS_PER_PATTERN; i++) {
-        steps[i].init(defaultValues,i, &triggerState, &pLockArmState, &currentIteration);
+        steps.locks[i] = NO_PARAMETER_LOCK;
+    }
+    for (int i = 0; i < TRIGGER_MASK_BITS; i++) {
+        steps.triggerConditions[i] = ~(StepMask)0;
     }
+    markEdited();
 }
 
-SequencerStep & SequencerPattern::doStep() {
+SequencerStep SequencerPattern::doStep() {
     if (++currentStep >= trackLength) {
         currentStep = 0;
         if (autoMutate){
             triggerState ^= triggerState << 2;
+            dirty = true;
+            markEdited();
         }
         currentIteration++;
     }
     return getCurrentStep();
 }
 
-void SequencerPattern::copyValuesFrom(SequencerPattern sourcePattern) {
+void SequencerPattern::copyValuesFrom(const SequencerPattern & sourcePattern) {
     trackLength = sourcePattern.trackLength;
     offset = sourcePattern.offset;
+    triggerState = sourcePattern.triggerState;
+    pLockArmState = sourcePattern.pLockArmState;
+    if (sourcePattern.stepBlock != stepBlock) {
+        // share the step data of the source
+        stepPool->retain(sourcePattern.stepBlock);
+        releaseSteps(stepBlock);
+        stepBlock = sourcePattern.stepBlock;
+    }
+    dirty = true;
+    markEdited();
+}
+
+void SequencerPattern::setTrackLength(StepIndex length) {
+    if (length == trackLength) {
+        return;
+    }
+    if (offset != 0) {
+        applyRotation();
+    }
+    trackLength = length;
+    dirty = true;
+    markEdited();
+}
+
+void SequencerPattern::applyRotation() {
+    StepData &steps = editSteps();
+    StepData rotated = steps;
+    StepMask triggers = triggerState;
+    StepMask pLocks = pLockArmState;
+    for (StepIndex i = 0; i < trackLength; i++) {
+        StepIndex from = getStepIndex(i);
+        // the locks are moved, not copied
+        rotated.locks[i] = steps.locks[from];
+        rotated.setTriggerMask(i, steps.getTriggerMask(from));
+        triggerState = (triggers & stepBit(from)) ? triggerState | stepBit(i) : triggerState & ~stepBit(i);
+        pLockArmState = (pLocks & stepBit(from)) ? pLockArmState | stepBit(i) : pLockArmState & ~stepBit(i);
+    }
+    steps = rotated;
+    offset = 0;
+    dirty = true;
+    markEdited();
+}
+
+void SequencerPattern::setSteps(const StepData &steps) {
+    if (stepPool->isShared(stepBlock)) {
+        stepPool->release(stepBlock);
+        stepBlock = stepPool->allocate();
+    }
+    stepPool->blocks[stepBlock] = steps;
+    markEdited();
+}
+
+void SequencerPattern::shareSteps(const SequencerPattern &source) {
+    if (source.stepBlock == stepBlock) {
+        return;
+    }
+    stepPool->retain(source.stepBlock);
+    stepPool->release(stepBlock);
+    stepBlock = source.stepBlock;
+    markEdited();
+}
+
+void SequencerPattern::unshareSteps() {
+    StepBlockIndex sharedBlock = stepBlock;
+    stepPool->release(sharedBlock);
+    stepBlock = stepPool->allocate();
+    StepData &steps = stepPool->blocks[stepBlock];
+    steps = stepPool->blocks[sharedBlock];
+    for (int i = 0; i < NUMBER_OF_STEPS_PER_PATTERN; i++) {
+        // the copy shares the locks, a lock is copied when it is changed (see TrackParameters::set)
+        parameters->retain(steps.locks[i]);
+    }
+}
+
+StepBlockIndex SequencerPattern::swapSteps(StepBlockIndex block) {
+    StepBlockIndex previousBlock = stepBlock;
+    stepBlock = block;
+    dirty = true;
+    markEdited();
+    return previousBlock;
+}
+
+void SequencerPattern::releaseSteps(StepBlockIndex block) {
+    if (!stepPool->release(block)) {
+        return;
+    }
+    // the last reference to the block, its locks are not needed anymore
+    StepData &steps = stepPool->blocks[block];
     for (int i = 0; i < NUMBER_OF_STEPS_PER_PATTERN; i++) {
-        steps[i].copyValuesFrom(sourcePattern.steps[i]);
+        parameters->release(steps.locks[i]);
     }
 }
 
+void SequencerPattern::clearLocks() {
+    StepData &steps = editSteps();
+    for (int i = 0; i < NUMBER_OF_STEPS_PER_PATTERN; i++) {
+        parameters->release(steps.locks[i]);
+        steps.locks[i] = NO_PARAMETER_LOCK;
+    }
+    markEdited();
+}
+
 bool SequencerPattern::isInPLockMode() {
     return pLockArmState > 0;
 }
 
 void SequencerPattern::turnOffPLockMode() {
-    pLockArmState = 0;
+    if (pLockArmState > 0) {
+        pLockArmState = 0;
+        dirty = true;
+    }
 }
 
 void SequencerPattern::togglePLockMode() {
@@ -64,9 +192,10 @@ void SequencerPattern::togglePLockMode() {
     } else {
         pLockArmState = triggerState;
     }
+    dirty = true;
 }
 
 void SequencerPattern::onStop() { 
-    currentStep = 16; 
+    currentStep = NUMBER_OF_STEPS_PER_PATTERN;
     currentIteration = 0b11111111;
 }
@@ -24,30 +24,135 @@
 #define SequencerPattern_h
 
 #include <inttypes.h>
+#include "SequencerConfig.h"
 #include "SequencerStep.h"
 #include "ParameterSet.h"
+#include "TrackParameters.h"
 
-#define NUMBER_OF_STEPS_PER_PATTERN 16
+#define NUMBER_OF_STEP_PARAMETERS 6
+// trigger conditions (the trigger mask of a step) repeat every 4 iterations of the pattern
+#define TRIGGER_CONDITION_ITERATIONS 4
+// bits of the trigger mask of a step (that can be edited and are saved)
+#define TRIGGER_MASK_BITS 6
+// blocks of step data (per track) in addition to the ones of the patterns, for step data that is only kept by the
+// edit history (undo of pattern copies, a/b versions)
+#define STEP_DATA_SPARE_BLOCKS 5
+#define STEP_DATA_BLOCKS (NUMBER_OF_PATTERNS + STEP_DATA_SPARE_BLOCKS)
+
+// a block of the step data pool or a number of references to it
+typedef BitMask<bitsFor(STEP_DATA_BLOCKS)>::type StepBlockIndex;
+// the blocks that share a lock are counted in TrackParameters::refCounts
+static_assert(STEP_DATA_BLOCKS < 256, "too many blocks of step data for the lock reference counts");
+
+/*
+ * The values of all steps of a pattern, stored per value (struct of arrays): the parameter locks of all steps are
+ * in one contiguous array. The parameters themselves are kept by the track (see TrackParameters), a step only has
+ * the index of its lock.
+ * The trigger masks are bit sliced: triggerConditions[i] has the bit i of the trigger masks of all steps, so the
+ * steps whose condition is on in an iteration are a single step mask.
+ */
+class StepData {
+   public:
+    uint8_t getTriggerMask(uint8_t step) const {
+        uint8_t mask = 0;
+        for (int i = 0; i < TRIGGER_MASK_BITS; i++) {
+            if (triggerConditions[i] & stepBit(step)) {
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+    }
+    void setTriggerMask(uint8_t step, uint8_t mask) {
+        for (int i = 0; i < TRIGGER_MASK_BITS; i++) {
+            if (mask & (1 << i)) {
+                triggerConditions[i] |= stepBit(step);
+            } else {
+                triggerConditions[i] &= ~stepBit(step);
+            }
+        }
+    }
+
+    LockIndex locks[NUMBER_OF_STEPS_PER_PATTERN];
+    StepMask triggerConditions[TRIGGER_MASK_BITS];
+};
+
+/*
+ * The step data of the patterns of a track. Patterns refer to a block of the pool, a copied pattern shares the block
+ * of its source (copy on write) until one of them is edited. There is a block for every pattern and for every block
+ * the edit history can keep, so a pattern that needs its own block always gets one.
+ */
+class StepDataPool {
+   public:
+    StepDataPool() { init(); };
+    // marks all blocks as free
+    void init();
+    // returns a free block (with a reference count of 1)
+    StepBlockIndex allocate();
+    void retain(StepBlockIndex block) { refCounts[block]++; }
+    // returns true if the block is not used anymore
+    bool release(StepBlockIndex block) { return --refCounts[block] == 0; }
+    bool isShared(StepBlockIndex block) { return refCounts[block] > 1; }
+
+    StepData blocks[STEP_DATA_BLOCKS];
+    StepBlockIndex refCounts[STEP_DATA_BLOCKS];
+};
 
 class SequencerPattern {
    public:
     SequencerPattern();
    
-    uint8_t trackLength;
+    StepIndex trackLength;
     bool autoMutate = false;
 
-    SequencerStep & getCurrentStep() { return steps[(offset + currentStep) % NUMBER_OF_STEPS_PER_PATTERN]; }
-    SequencerStep & getStep(uint8_t index) { return steps[(offset + index) % NUMBER_OF_STEPS_PER_PATTERN]; }
-    int8_t getCurrentStepIndex() {return currentStep % NUMBER_OF_STEPS_PER_PATTERN;}
-    void setCurrentStepIndex(uint8_t index){
+    SequencerStep getCurrentStep() { return SequencerStep(this, getStepIndex(currentStep)); }
+    SequencerStep getStep(StepIndex index) { return SequencerStep(this, getStepIndex(index)); }
+    StepIndex getCurrentStepIndex() {return currentStep % NUMBER_OF_STEPS_PER_PATTERN;}
+    // true if the next doStep() starts the pattern over
+    bool isLastStep() {return currentStep + 1 >= trackLength;}
+    void setCurrentStepIndex(StepIndex index){
        currentStep = index % NUMBER_OF_STEPS_PER_PATTERN;
     }
 
-    void init(ParameterSet defaultValues);
-    void copyValuesFrom(SequencerPattern sourcePattern);
+    // clears all steps. the step data is kept in stepDataPool, the parameter locks of the steps in trackParameters.
+    void init(TrackParameters *trackParameters, StepDataPool *stepDataPool);
+    // copies another pattern of the same track. the step data is shared until one of the patterns is changed.
+    void copyValuesFrom(const SequencerPattern & sourcePattern);
+    const StepData &getSteps() const { return stepPool->blocks[stepBlock]; }
+    // returns the step data for changing it (the pattern gets its own copy if the data is shared)
+    StepData &editSteps() {
+        if (stepPool->isShared(stepBlock)) {
+            unshareSteps();
+        }
+        return stepPool->blocks[stepBlock];
+    }
+    // replaces the step data. the locks in steps have to be valid for the track parameters, the locks of the
+    // replaced data are not released (used when a whole track is replaced).
+    void setSteps(const StepData &steps);
+    // makes the pattern share the step data of another pattern of the track. like setSteps(), the locks of the replaced
+    // data are not released.
+    void shareSteps(const SequencerPattern &source);
+    // patterns with the same block share their step data
+    StepBlockIndex getStepBlock() const { return stepBlock; }
+    // references to the step data that are kept outside of the pattern (edit history): retainSteps() returns the
+    // block of the pattern with an additional reference, swapSteps() makes the pattern use another block (taking over
+    // its reference) and returns the previous one, releaseSteps() drops a reference.
+    StepBlockIndex retainSteps() {
+        stepPool->retain(stepBlock);
+        return stepBlock;
+    }
+    StepBlockIndex swapSteps(StepBlockIndex block);
+    void releaseSteps(StepBlockIndex block);
+    // removes the parameter locks of all steps
+    void clearLocks();
 
     // does a Step and returns the new step
-    SequencerStep & doStep();
+    SequencerStep doStep();
+    // number of times the pattern was played through (used by the trigger conditions)
+    uint8_t getIteration() {return currentIteration;}
+    // the steps whose trigger condition is on in the current iteration
+    StepMask getConditionSteps() {
+        return getSteps().triggerConditions[currentIteration % TRIGGER_CONDITION_ITERATIONS];
+    }
 
     void onStop();
 
@@ -60,18 +165,69 @@ class SequencerPattern {
 
     void turnOffPLockMode();
 
-    void rotate(uint8_t steps){offset = steps;}
+    // changes the track length. the rotation wraps at the track length, so it is applied to the steps first (offset 0)
+    // to keep the steps at the positions they are played at.
+    void setTrackLength(StepIndex length);
+    // rotates the steps within the track length
+    void rotate(StepIndex steps){
+       if (offset != steps){
+          offset = steps;
+          dirty = true;
+          markEdited();
+       }
+    }
 
-    // all steps store their 1bit states in the following two 16bit ints.
+    // every change of the trigger events of the pattern (triggers, trigger masks, locks, length, rotation) is counted,
+    // the track that plays the pattern updates its event list when the count changed (see SequencerTrack).
+    // markStepEdited() is for a change of one step (the track only updates its event), markEdited() for the others.
+    void markStepEdited(StepIndex index) {
+        editedStep = index;
+        editCount++;
+    }
+    void markEdited() {
+        editedStep = NUMBER_OF_STEPS_PER_PATTERN;
+        editCount++;
+    }
+    uint16_t getEditCount() { return editCount; }
+    // the step of the last edit, NUMBER_OF_STEPS_PER_PATTERN if it changed more than one step
+    StepIndex getEditedStep() { return editedStep; }
+    // the playhead position a step is played at (the inverse of the rotation), NUMBER_OF_STEPS_PER_PATTERN for the
+    // steps after the end of the track
+    StepIndex getStepPosition(StepIndex index) {
+        return index < trackLength ? (index + trackLength - offset) % trackLength : NUMBER_OF_STEPS_PER_PATTERN;
+    }
+
+    // a pattern is dirty when it was changed since it was last loaded or saved, only dirty patterns need to be
+    // written when saving to the same project again.
+    void markDirty(){dirty = true;}
+    bool isDirty(){return dirty;}
+    void clearDirty(){dirty = false;}
+
+    // all steps store their 1bit states in the following two masks (bit n is step n).
     // because of this, functions like togglePLockMode become very simple and do not need to iterate through all steps.
-    uint16_t triggerState = 0;
-    uint16_t pLockArmState = 0;
-    uint8_t offset = 0;
-    SequencerStep steps[NUMBER_OF_STEPS_PER_PATTERN];
+    StepMask triggerState = 0;
+    StepMask pLockArmState = 0;
+    StepIndex offset = 0;
+    TrackParameters *parameters;
 
    private:
-    uint8_t currentStep = 16;
+    void unshareSteps();
+    // moves the steps to the positions they are played at and sets the offset to 0
+    void applyRotation();
+
+    // maps a step position (playhead / step buttons) to the stored step. steps after the end of the track are not
+    // rotated.
+    StepIndex getStepIndex(StepIndex index) {
+        return index < trackLength ? (offset + index) % trackLength : index % NUMBER_OF_STEPS_PER_PATTERN;
+    }
+
+    StepDataPool *stepPool;
+    StepBlockIndex stepBlock;
+    StepIndex currentStep = NUMBER_OF_STEPS_PER_PATTERN;
     uint8_t currentIteration = 0b11111111;
+    bool dirty = true;
+    uint16_t editCount = 0;
+    StepIndex editedStep = NUMBER_OF_STEPS_PER_PATTERN;
 
     
 };
@@ -20,68 +20,72 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+
 #include "SequencerStep.h"
+#include "SequencerPattern.h"
 #include "Arduino.h"
 
-#define TRIGGER_STATE 0
-#define PLOCK_REC_STATE 1
-
-SequencerStep::SequencerStep() {}
-
-void SequencerStep::init(ParameterSet defaultValues, uint8_t stepIdx, uint16_t *trState, uint16_t *pLState, uint8_t *patternIter) {
-    
-    params = defaultValues;
-    stepIndex = stepIdx;
-    triggerState = trState;
-    pLockArmState = pLState;
-    patternIteration = patternIter;
-    triggerMask = 0b00111111;
-    
-}
-
 void SequencerStep::toggleTriggerState() {
     // toggle trigger state bit
-    *triggerState ^= _BV(stepIndex);
+    pattern->triggerState ^= stepBit(index);
+    pattern->markStepEdited(index);
 }
 
 bool SequencerStep::isTriggerOn() {
     // return value of trigger state bit
-    return *triggerState & _BV(stepIndex);
+    return pattern->triggerState & stepBit(index);
 }
 
 bool  SequencerStep::isTriggerConditionOn() {
-    return triggerMask & _BV(*patternIteration % iterationMod);
+    return pattern->getConditionSteps() & stepBit(index);
 }
 
 void SequencerStep::toggleParameterLockRecord() {
     // toggle the plock bit
-    *pLockArmState ^= _BV(stepIndex);
+    pattern->pLockArmState ^= stepBit(index);
     // if you turn on plock for a step, we also make sure a trigger is set (no steps with plock on, but no trigger)
     if (isParameterLockOn()){
-        *triggerState |= _BV(stepIndex);
+        pattern->triggerState |= stepBit(index);
+        pattern->markStepEdited(index);
     }
 }
 
 void SequencerStep::setTriggerOn(){
-    *triggerState |= _BV(stepIndex);
+    pattern->triggerState |= stepBit(index);
+    pattern->markStepEdited(index);
 }
 void SequencerStep::setTriggerOff(){
-    *triggerState &= ~_BV(stepIndex);
+    pattern->triggerState &= ~stepBit(index);
+    pattern->markStepEdited(index);
 }
 
 void SequencerStep::setParameterLockRecordOn() {
     // sets the plock bit
-    *pLockArmState |= _BV(stepIndex);
+    pattern->pLockArmState |= stepBit(index);
 }
 
 void SequencerStep::setParameterLockRecordOff() {
     // clears the plock bit
-    *pLockArmState &= ~_BV(stepIndex);
+    pattern->pLockArmState &= ~stepBit(index);
 }
 
-bool SequencerStep::isParameterLockOn() { return *pLockArmState & _BV(stepIndex); }
-
-void SequencerStep::copyValuesFrom(SequencerStep sourceStep) {
+bool SequencerStep::isParameterLockOn() { return pattern->pLockArmState & stepBit(index); }
+
+bool SequencerStep::copyValuesFrom(SequencerStep sourceStep) {
+    TrackParameters *parameters = pattern->parameters;
+    StepData &steps = pattern->editSteps();
+    const StepData &sourceSteps = sourceStep.pattern->getSteps();
+    // a block refers to a lock with one step only, equal locks mean there is nothing to copy (same step or no locks)
+    LockIndex sourceLock = sourceSteps.locks[sourceStep.index];
+    if (steps.locks[index] != sourceLock) {
+        LockIndex lock = parameters->duplicate(sourceLock);
+        if (lock == NO_PARAMETER_LOCK && sourceLock != NO_PARAMETER_LOCK) {
+            return false;
+        }
+        parameters->release(steps.locks[index]);
+        steps.locks[index] = lock;
+    }
+    steps.setTriggerMask(index, sourceSteps.getTriggerMask(sourceStep.index));
     if (sourceStep.isTriggerOn()){
         setTriggerOn();
     } else {
@@ -92,11 +96,59 @@ void SequencerStep::copyValuesFrom(SequencerStep sourceStep) {
     } else {
         setParameterLockRecordOff();
     }
-    //state = sourceStep.state;
-    params = sourceStep.params;
-    triggerMask = sourceStep.triggerMask;
-    iterationMod = sourceStep.iterationMod;
+    pattern->markStepEdited(index);
+    return true;
+}
+
+ParameterSet SequencerStep::getParams() { return unpackParameters(pattern->parameters->get(pattern->getSteps().locks[index])); }
+
+uint16_t SequencerStep::getParam(uint8_t parameter) {
+    return unpackParameter(pattern->parameters->get(pattern->getSteps().locks[index]), parameter);
+}
+
+bool SequencerStep::setParam(uint8_t parameter, uint16_t value) {
+    LockIndex &lock = pattern->editSteps().locks[index];
+    LockIndex previousLock = lock;
+    if (!pattern->parameters->set(lock, parameter, value)) {
+        return false;
+    }
+    if (lock != previousLock) {
+        // the values of a lock are read when the step fires, only a new lock changes the event
+        pattern->markStepEdited(index);
+    }
+    return true;
+}
+
+bool SequencerStep::isLocked() { return pattern->getSteps().locks[index] != NO_PARAMETER_LOCK; }
+
+void SequencerStep::clearLocks() {
+    LockIndex &lock = pattern->editSteps().locks[index];
+    pattern->parameters->release(lock);
+    lock = NO_PARAMETER_LOCK;
+    pattern->markStepEdited(index);
+}
+
+uint8_t SequencerStep::getLockMask() { return pattern->parameters->getMask(pattern->getSteps().locks[index]); }
+
+bool SequencerStep::setLocks(uint8_t mask, PackedParameterSet values) {
+    LockIndex &lock = pattern->editSteps().locks[index];
+    LockIndex created = pattern->parameters->create(mask, values);
+    if (mask != 0 && created == NO_PARAMETER_LOCK) {
+        return false;
+    }
+    pattern->parameters->release(lock);
+    lock = created;
+    pattern->markStepEdited(index);
+    return true;
+}
+
+uint8_t SequencerStep::getTriggerMask() { return pattern->getSteps().getTriggerMask(index); }
 
+void SequencerStep::setTriggerMask(uint8_t mask) {
+    if (getTriggerMask() != mask) {
+        pattern->editSteps().setTriggerMask(index, mask);
+        pattern->markStepEdited(index);
+    }
 }
 
 CRGB SequencerStep::getColor() {
@@ -20,6 +20,7 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+
 #ifndef SequencerStep_h
 #define SequencerStep_h
 
@@ -27,9 +28,15 @@
 #include <inttypes.h>
 #include "ParameterSet.h"
 
+class SequencerPattern;
+
+/*
+ * A step of a pattern. A step does not hold any values itself, it is a light weight view (pattern + step index) onto
+ * the step arrays of its pattern, and is passed around by value.
+ */
 class SequencerStep {
    public:
-    SequencerStep();
+    SequencerStep(SequencerPattern *pattern, uint8_t index) : pattern(pattern), index(index){};
 
     void toggleTriggerState();
     bool isTriggerOn();
@@ -41,27 +48,33 @@ class SequencerStep {
     void setParameterLockRecordOn();
     void setParameterLockRecordOff();
     bool isParameterLockOn();
-    void copyValuesFrom(SequencerStep sourceStep);
-    void init(ParameterSet defaultValues, uint8_t stepIdx, uint16_t *trState, uint16_t *pLState, uint8_t *patternIter);
+    // returns false (and leaves the step unchanged) if the track has no free locks left
+    bool copyValuesFrom(SequencerStep sourceStep);
+
+    // returns the parameters of the step: the base parameters of the track, merged with the locks of the step
+    ParameterSet getParams();
+    // parameter 0..5
+    uint16_t getParam(uint8_t parameter);
+    // locks a parameter of the step to value. returns false (and leaves the step unchanged) if the track has no free
+    // locks left.
+    bool setParam(uint8_t parameter, uint16_t value);
+    bool isLocked();
+    void clearLocks();
+    // returns which parameters the step locks (bit n for parameter n)
+    uint8_t getLockMask();
+    // replaces the locks of the step. returns false (and leaves the step unchanged) if the track has no free locks left.
+    bool setLocks(uint8_t mask, PackedParameterSet values);
+    uint8_t getTriggerMask();
+    void setTriggerMask(uint8_t mask);
 
     //uint8_t getState();
     CRGB getColor();
+    // the index of the step in the pattern (not rotated)
+    uint8_t getIndex() { return index; }
 
-    ParameterSet params;
-
-    uint8_t triggerMask;
-    uint8_t iterationMod = 4;
-    
    private:
-    uint8_t stepIndex;
-    uint16_t *triggerState;
-    uint16_t *pLockArmState;
-    uint8_t *patternIteration;
-    
-    
-    
-
-
+    SequencerPattern *pattern;
+    uint8_t index;
 };
 
 #endif
@@ -22,54 +22,174 @@
 
 #include "SequencerTrack.h"
 #include "Arduino.h"
-
-// bit=0:track is not muted
-// bit=1:track is muted
-#define MUTE_STATE_BIT 0
+#include "Trace.h"
 
 // bit=0:dont change mute state on next update
 // bit=1:toggle mute state on next update
 #define MUTE_ARM_STATE_BIT 1
 
-SequencerTrack::SequencerTrack() : currentPattern(0), state(0) {}
+// bit=1:track settings changed since last load/save
+#define SETTINGS_DIRTY_BIT 2
+
+SequencerTrack::SequencerTrack() : currentPattern(0), state(_BV(SETTINGS_DIRTY_BIT)) {}
 
 void SequencerTrack::init(ParameterSet defaultValues) {
+    parameters.clear();
+    parameters.base = packParameters(defaultValues);
+    stepPool.init();
     for (auto &pattern : patterns) {
-        pattern.init(defaultValues);
+        pattern.init(&parameters, &stepPool);
+    }
+}
+
+void SequencerTrack::setBaseParameter(uint8_t parameter, uint16_t value) {
+    if (unpackParameter(parameters.base, parameter) != clampParameter(value)) {
+        parameters.base = setPackedParameter(parameters.base, parameter, value);
+        markSettingsDirty();
     }
 }
-void SequencerTrack::initPatternOpsArmState(uint8_t trackIdx, uint8_t *patternOpsArmSt) {
+void SequencerTrack::initSharedState(uint8_t trackIdx, TrackMask *patternOpsArmSt, TrackMask *muteSt) {
     trackIndex = trackIdx;
     patternOpsArmState = patternOpsArmSt;
+    muteState = muteSt;
+}
+
+SequencerStep SequencerTrack::doStep() {
+    SequencerStep step = patterns[currentPattern].doStep();
+    updateEvents();
+    StepIndex position = patterns[currentPattern].getCurrentStepIndex();
+    if (position == eventsPosition + 1) {
+        // the next step, at most one event to pass
+        if (eventCursor < eventCount && events[eventCursor].position == position) {
+            eventCursor++;
+        }
+    } else {
+        // the pattern started over or the playhead was moved
+        seekEvent(position);
+    }
+    eventsPosition = position;
+    return step;
+}
+
+bool SequencerTrack::isCurrentStepFiring() {
+    // the step may have been edited after doStep() (recording locks)
+    updateEvents();
+    if (eventCursor == 0 || events[eventCursor - 1].position != eventsPosition) {
+        return false;
+    }
+    uint8_t iteration = patterns[currentPattern].getIteration() % TRIGGER_CONDITION_ITERATIONS;
+    return events[eventCursor - 1].triggerMask & (1 << iteration);
+}
+
+const TriggerEvent *SequencerTrack::getNextEvent(StepIndex &stepsAhead) {
+    updateEvents();
+    if (eventCount == 0) {
+        return NULL;
+    }
+    if (eventCursor < eventCount) {
+        stepsAhead = events[eventCursor].position - eventsPosition;
+        return &events[eventCursor];
+    }
+    stepsAhead = patterns[currentPattern].trackLength - eventsPosition + events[0].position;
+    return &events[0];
+}
+
+void SequencerTrack::updateEvents() {
+    SequencerPattern &pattern = patterns[currentPattern];
+    if (eventsPattern == currentPattern && eventsEditCount == pattern.getEditCount()) {
+        return;
+    }
+    if (eventsPattern == currentPattern && (uint16_t)(eventsEditCount + 1) == pattern.getEditCount() &&
+        pattern.getEditedStep() < NUMBER_OF_STEPS_PER_PATTERN) {
+        updateEvent(pattern.getEditedStep());
+    } else {
+        compileEvents();
+    }
+    eventsPattern = currentPattern;
+    eventsEditCount = pattern.getEditCount();
+}
+
+void SequencerTrack::compileEvents() {
+    SequencerPattern &pattern = patterns[currentPattern];
+    const StepData &steps = pattern.getSteps();
+    eventCount = 0;
+    for (StepIndex position = 0; position < pattern.trackLength; position++) {
+        SequencerStep step = pattern.getStep(position);
+        if (step.isTriggerOn()) {
+            TriggerEvent &event = events[eventCount++];
+            event.position = position;
+            event.step = step.getIndex();
+            event.triggerMask = steps.getTriggerMask(event.step);
+            event.lock = steps.locks[event.step];
+        }
+    }
+    seekEvent(eventsPosition);
+}
+
+void SequencerTrack::updateEvent(StepIndex step) {
+    SequencerPattern &pattern = patterns[currentPattern];
+    StepIndex position = pattern.getStepPosition(step);
+    if (position >= pattern.trackLength) {
+        // not played
+        return;
+    }
+    StepIndex e = 0;
+    while (e < eventCount && events[e].position < position) {
+        e++;
+    }
+    bool exists = e < eventCount && events[e].position == position;
+    if (!(pattern.triggerState & stepBit(step))) {
+        if (exists) {
+            memmove(&events[e], &events[e + 1], (eventCount - e - 1) * sizeof(TriggerEvent));
+            eventCount--;
+            if (position <= eventsPosition) {
+                eventCursor--;
+            }
+        }
+        return;
+    }
+    if (!exists) {
+        memmove(&events[e + 1], &events[e], (eventCount - e) * sizeof(TriggerEvent));
+        eventCount++;
+        // the events up to the playhead are before the cursor
+        if (position <= eventsPosition) {
+            eventCursor++;
+        }
+    }
+    const StepData &steps = pattern.getSteps();
+    events[e].position = position;
+    events[e].step = step;
+    events[e].triggerMask = steps.getTriggerMask(step);
+    events[e].lock = steps.locks[step];
 }
 
-SequencerStep & SequencerTrack::doStep() { return patterns[currentPattern].doStep(); }
+void SequencerTrack::seekEvent(StepIndex position) {
+    eventCursor = 0;
+    while (eventCursor < eventCount && events[eventCursor].position <= position) {
+        eventCursor++;
+    }
+}
 
 void SequencerTrack::onStop() {
     for (auto &pattern : patterns) {
         pattern.onStop();
     }
+    eventsPosition = NUMBER_OF_STEPS_PER_PATTERN;
+    eventCursor = 0;
 }
 
-SequencerStep &SequencerTrack::getCurrentStep() { return patterns[currentPattern].getCurrentStep(); }
+SequencerStep SequencerTrack::getCurrentStep() { return patterns[currentPattern].getCurrentStep(); }
 
 SequencerPattern &SequencerTrack::getCurrentPattern() { return patterns[currentPattern]; }
 
-uint8_t SequencerTrack::getCurrentPatternIndex() { return currentPattern; }
+PatternIndex SequencerTrack::getCurrentPatternIndex() { return currentPattern; }
 
-void SequencerTrack::switchToPattern(uint8_t number) {
+void SequencerTrack::switchToPattern(PatternIndex number) {
+    TRACE_EVENT(PATTERN_SWITCH, trackIndex, number);
     patterns[number].setCurrentStepIndex(patterns[currentPattern].getCurrentStepIndex());
     currentPattern = number;
 }
 
-void SequencerTrack::toggleMute() { state ^= _BV(MUTE_STATE_BIT); }
-
-void SequencerTrack::mute() { state |= _BV(MUTE_STATE_BIT); }
-
-void SequencerTrack::unMute() { state &= ~_BV(MUTE_STATE_BIT); }
-
-bool SequencerTrack::isMuted() { return state & _BV(MUTE_STATE_BIT); }
-
 bool SequencerTrack::isArmed() { return state & _BV(MUTE_ARM_STATE_BIT); }
 
 void SequencerTrack::toggleMuteArm() { state ^= _BV(MUTE_ARM_STATE_BIT); }
@@ -81,3 +201,14 @@ void SequencerTrack::activateMuteArms() {
         state &= ~_BV(MUTE_ARM_STATE_BIT);
     }
 }
+
+void SequencerTrack::markSettingsDirty() { state |= _BV(SETTINGS_DIRTY_BIT); }
+
+bool SequencerTrack::isSettingsDirty() { return state & _BV(SETTINGS_DIRTY_BIT); }
+
+void SequencerTrack::clearDirty() {
+    state &= ~_BV(SETTINGS_DIRTY_BIT);
+    for (auto &pattern : patterns) {
+        pattern.clearDirty();
+    }
+}
@@ -28,48 +28,103 @@
 #include "ParameterSet.h"
 #include "SequencerPattern.h"
 #include "SequencerStep.h"
+#include "TrackParameters.h"
 
-#define NUMBER_OF_PATTERNS 16
+
+/*
+ * A step of the playing pattern that has a trigger, as the track plays it: the playhead position, the step, the
+ * conditions (bit n of the trigger mask: fires in iteration n) and the lock of its parameters. The values of the lock
+ * are read when the event fires, the pots change them on every loop.
+ */
+class TriggerEvent {
+   public:
+    StepIndex position;
+    StepIndex step;
+    uint8_t triggerMask;
+    LockIndex lock;
+};
 
 class SequencerTrack {
    public:
     SequencerTrack();
     SequencerPattern &getCurrentPattern();
-    uint8_t getCurrentPatternIndex();
-    SequencerStep &getCurrentStep();
+    PatternIndex getCurrentPatternIndex();
+    SequencerStep getCurrentStep();
 
     // does a Step and returns 1 if the new step is a trigger, 0 if it is not a
     // trigger
     void init(ParameterSet defaultValues);
-    void initPatternOpsArmState(uint8_t trackIdx, uint8_t *patternOpsArmSt);
-    SequencerStep & doStep();
+    // changes a base parameter (0..5) of the track, used by all steps that do not lock it
+    void setBaseParameter(uint8_t parameter, uint16_t value);
+    uint16_t getBaseParameter(uint8_t parameter) { return unpackParameter(parameters.base, parameter); }
+    ParameterSet getBaseParams() { return unpackParameters(parameters.base); }
+    // the pattern ops arm and mute states of all tracks are kept by the sequencer (one bit per track)
+    void initSharedState(uint8_t trackIdx, TrackMask *patternOpsArmSt, TrackMask *muteSt);
+    SequencerStep doStep();
+    // true if the step of the last doStep() has a trigger whose condition is on (the mute state is not checked)
+    bool isCurrentStepFiring();
+    // the parameters of the step of the last doStep(), if isCurrentStepFiring()
+    ParameterSet getFiringParams() { return unpackParameters(parameters.get(events[eventCursor - 1].lock)); }
+    // lookahead: returns the next event after the playhead (the first one of the next iteration if there is none
+    // before the end of the pattern) and the steps until it in stepsAhead, NULL if the pattern has no triggers.
+    // the condition of the event is not checked.
+    const TriggerEvent *getNextEvent(StepIndex &stepsAhead);
     void onStop();
 
-    void toggleMute();
-    void unMute();
-    void mute();
-    bool isMuted();
+    void toggleMute() { *muteState ^= trackBit(trackIndex); }
+    void unMute() { *muteState &= ~trackBit(trackIndex); }
+    void mute() { *muteState |= trackBit(trackIndex); }
+    bool isMuted() { return *muteState & trackBit(trackIndex); }
     bool isArmed();
     void toggleMuteArm();
     void activateMuteArms();
 
-    void togglePatternOpsArm() { *patternOpsArmState ^= _BV(trackIndex); }
-    void deactivatePatternOpsArm() { *patternOpsArmState &= ~_BV(trackIndex); }
-    bool isPatternOpsArmed() { return *patternOpsArmState & _BV(trackIndex); }
+    void togglePatternOpsArm() { *patternOpsArmState ^= trackBit(trackIndex); }
+    void deactivatePatternOpsArm() { *patternOpsArmState &= ~trackBit(trackIndex); }
+    bool isPatternOpsArmed() { return *patternOpsArmState & trackBit(trackIndex); }
 
-    void switchToPattern(uint8_t number);
+    void switchToPattern(PatternIndex number);
+
+    // track settings (gains) were changed since the project was last loaded or saved
+    void markSettingsDirty();
+    bool isSettingsDirty();
+    // clears the dirty flags of the track settings and all patterns
+    void clearDirty();
 
     SequencerPattern patterns[NUMBER_OF_PATTERNS];
+    TrackParameters parameters;
+    StepDataPool stepPool;
 
    private:
+    // brings the event list up to date with the edits of the playing pattern
+    void updateEvents();
+    void compileEvents();
+    // updates the event of one step (added, removed or changed)
+    void updateEvent(StepIndex step);
+    // moves the event cursor behind the events up to the playhead position
+    void seekEvent(StepIndex position);
+
     uint8_t trackIndex;
-    uint8_t *patternOpsArmState;
+    TrackMask *patternOpsArmState;
+    TrackMask *muteState;
 
     // the currently active pattern
-    uint8_t currentPattern;
-    // bit 0: mute/unmuted
+    PatternIndex currentPattern;
     // bit 1: mute/unmute arm state
+    // bit 2: settings dirty
     uint8_t state;
+
+    // the steps of the playing pattern that have a trigger, in play order. the list follows the edits of the pattern
+    // (see SequencerPattern::markEdited), so doStep() only compares the playhead with the next event.
+    TriggerEvent events[NUMBER_OF_STEPS_PER_PATTERN];
+    StepIndex eventCount = 0;
+    // the first event after the playhead, the event before it is at the playhead if their positions are equal
+    StepIndex eventCursor = 0;
+    // the pattern and its edit count the list is up to date with
+    PatternIndex eventsPattern = NUMBER_OF_PATTERNS;
+    uint16_t eventsEditCount = 0;
+    // playhead position of the last doStep(), NUMBER_OF_STEPS_PER_PATTERN before the first one
+    StepIndex eventsPosition = NUMBER_OF_STEPS_PER_PATTERN;
 };
 
 #endif /* defined(__StepSequencerTeensy__SequencerTrack__) */
@@ -0,0 +1,193 @@
+#include "SessionStore.h"
+#include "ProjectSnapshot.h"
+#include "Crc32.h"
+
+// "SES4". changed with the layout of the snapshot, records of older versions are not restored (the size alone does
+// not tell them apart)
+#define SESSION_MAGIC 0x34534553
+#define FLASH_PHRASE_SIZE 8
+
+// a record is a header followed by the snapshot, rounded up to whole sectors
+class SessionHeader {
+   public:
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t length;
+    uint32_t crc;
+};
+
+#define SESSION_DATA_SIZE ((sizeof(ProjectSnapshot) + FLASH_PHRASE_SIZE - 1) / FLASH_PHRASE_SIZE * FLASH_PHRASE_SIZE)
+#define SESSION_RECORD_SECTORS ((sizeof(SessionHeader) + SESSION_DATA_SIZE + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE)
+#define SESSION_RECORD_SIZE (SESSION_RECORD_SECTORS * FLASH_SECTOR_SIZE)
+#define SESSION_RECORDS (SESSION_FLASH_SIZE / SESSION_RECORD_SIZE)
+
+#ifdef SESSION_STORE_AVAILABLE
+
+#define FLASH_CMD_PROGRAM_PHRASE 0x07
+#define FLASH_CMD_ERASE_SECTOR 0x09
+
+static const uint8_t *recordAddress(uint8_t record) {
+    return (const uint8_t *)(uintptr_t)(SESSION_FLASH_START + record * SESSION_RECORD_SIZE);
+}
+
+static uint8_t nextRecord(uint8_t record) { return (record + 1) % SESSION_RECORDS; }
+
+// runs a flash command and waits until it is done. there are no flash commands in HSRUN mode, the cpu is slowed
+// down for the duration of the command (like the eeprom functions of the teensy core do). returns false if it failed.
+static bool flashCommand(uint8_t command, uint32_t address, const uint8_t *data) {
+    kinetis_hsrun_disable();
+    // clear the error flags of the previous command
+    FTFL_FSTAT = FTFL_FSTAT_ACCERR | FTFL_FSTAT_FPVIOL;
+    *(volatile uint32_t *)&FTFL_FCCOB3 = (command << 24) | address;
+    if (data != NULL) {
+        uint32_t words[2];
+        memcpy(words, data, FLASH_PHRASE_SIZE);
+        *(volatile uint32_t *)&FTFL_FCCOB7 = words[0];
+        *(volatile uint32_t *)&FTFL_FCCOBB = words[1];
+    }
+    FTFL_FSTAT = FTFL_FSTAT_CCIF;
+    while (!(FTFL_FSTAT & FTFL_FSTAT_CCIF)) {
+    }
+    kinetis_hsrun_enable();
+    return !(FTFL_FSTAT & (FTFL_FSTAT_ACCERR | FTFL_FSTAT_FPVIOL | FTFL_FSTAT_MGSTAT0));
+}
+
+#else
+
+static const uint8_t *recordAddress(uint8_t record) { return NULL; }
+
+#endif
+
+bool SessionStore::isValid(uint8_t r) {
+#ifdef SESSION_STORE_AVAILABLE
+    const SessionHeader *header = (const SessionHeader *)recordAddress(r);
+    return header->magic == SESSION_MAGIC && header->length == sizeof(ProjectSnapshot) &&
+           crc32(recordAddress(r) + sizeof(SessionHeader), header->length) == header->crc;
+#else
+    return false;
+#endif
+}
+
+bool SessionStore::restore(ProjectSnapshot &snapshot) {
+    int8_t newest = -1;
+    for (uint8_t r = 0; r < SESSION_RECORDS; r++) {
+        if (!isValid(r)) {
+            continue;
+        }
+        const SessionHeader *header = (const SessionHeader *)recordAddress(r);
+        if (newest < 0 || (int32_t)(header->sequence - sequence) > 0) {
+            newest = r;
+            sequence = header->sequence;
+        }
+    }
+    if (newest < 0) {
+        return false;
+    }
+    const SessionHeader *header = (const SessionHeader *)recordAddress(newest);
+    memcpy(&snapshot, recordAddress(newest) + sizeof(SessionHeader), sizeof(ProjectSnapshot));
+    storedCrc = header->crc;
+    // continue with the record after the newest one
+    record = newest;
+    return true;
+}
+
+bool SessionStore::startStore(const ProjectSnapshot &snapshot, uint32_t crc) {
+#ifdef SESSION_STORE_AVAILABLE
+    if (state != IDLE || !prepared || failed) {
+        return false;
+    }
+    source = (const uint8_t *)&snapshot;
+    sourceCrc = crc;
+    position = 0;
+    // the erased record is used up, even if storing is aborted
+    prepared = false;
+    state = PROGRAMMING;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void SessionStore::update(bool eraseAllowed) {
+#ifdef SESSION_STORE_AVAILABLE
+    if (failed) {
+        return;
+    }
+    if (state == IDLE && !prepared && eraseAllowed) {
+        state = ERASING;
+        position = 0;
+    }
+    if (state == ERASING) {
+        // erasing a sector blocks for several ms, one sector per call (and only while it is allowed)
+        if (eraseAllowed && !runNextCommand()) {
+            failed = true;
+            state = IDLE;
+        }
+        return;
+    }
+    uint32_t start = micros();
+    while (isStoring() && micros() - start < SESSION_STORE_TIME_BUDGET_MICROS) {
+        if (!runNextCommand()) {
+            failed = true;
+            state = IDLE;
+        }
+    }
+#endif
+}
+
+bool SessionStore::runNextCommand() {
+#ifdef SESSION_STORE_AVAILABLE
+    uint8_t next = nextRecord(record);
+    uint32_t address = SESSION_FLASH_START + next * SESSION_RECORD_SIZE;
+    switch (state) {
+        case ERASING:
+            if (!flashCommand(FLASH_CMD_ERASE_SECTOR, address + position * FLASH_SECTOR_SIZE, NULL)) {
+                return false;
+            }
+            position++;
+            if (position == SESSION_RECORD_SECTORS) {
+                prepared = true;
+                state = IDLE;
+            }
+            return true;
+        case PROGRAMMING:
+            if (position < SESSION_DATA_SIZE) {
+                uint8_t phrase[FLASH_PHRASE_SIZE];
+                memset(phrase, 0xFF, FLASH_PHRASE_SIZE);
+                uint32_t length = sizeof(ProjectSnapshot) - position;
+                memcpy(phrase, source + position, length < FLASH_PHRASE_SIZE ? length : FLASH_PHRASE_SIZE);
+                uint32_t target = address + sizeof(SessionHeader) + position;
+                position += FLASH_PHRASE_SIZE;
+                return flashCommand(FLASH_CMD_PROGRAM_PHRASE, target, phrase);
+            }
+            // the header goes last, it makes the record valid
+            if (position < SESSION_DATA_SIZE + sizeof(SessionHeader)) {
+                SessionHeader header;
+                header.magic = SESSION_MAGIC;
+                header.sequence = sequence + 1;
+                header.length = sizeof(ProjectSnapshot);
+                header.crc = sourceCrc;
+                uint32_t offset = position - SESSION_DATA_SIZE;
+                position += FLASH_PHRASE_SIZE;
+                return flashCommand(FLASH_CMD_PROGRAM_PHRASE, address + offset, (const uint8_t *)&header + offset);
+            }
+            state = FINISHING;
+            return true;
+        case FINISHING:
+            // drop the old contents of the record from the flash cache before reading it back
+            FMC_PFB01CR |= FMC_PFB01CR_CINV_WAY(15);
+            state = IDLE;
+            if (!isValid(next)) {
+                return false;
+            }
+            record = next;
+            sequence++;
+            storedCrc = sourceCrc;
+            return true;
+        default:
+            return true;
+    }
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,78 @@
+#ifndef SessionStore_h
+#define SessionStore_h
+
+#include <inttypes.h>
+#include "Arduino.h"
+
+// the session is kept in the last 128kB of the program flash of the teensy 3.6. This is the second flash block, the
+// cpu can keep running code from the first block (and audio keeps playing) while it is erased / programmed.
+// the sketch must stay in the first block (below 512kB), session_flash.ld makes the link fail otherwise. It is added
+// to the linker flags of the build (e.g. to teensy36.build.flags.ld in boards.local.txt).
+#if defined(__MK66FX1M0__)
+#define SESSION_STORE_AVAILABLE
+#endif
+#define SESSION_FLASH_START 0xE0000
+#define SESSION_FLASH_SIZE 0x20000
+#define FLASH_SECTOR_SIZE 4096
+
+// max time (in micros) spent programming per call to update()
+#define SESSION_STORE_TIME_BUDGET_MICROS 500
+// min time between two stored sessions, limits the wear of the flash when the state changes all the time
+#define SESSION_STORE_MIN_INTERVAL_MILLIS 300000
+
+class ProjectSnapshot;
+
+/*
+ * Keeps copies of the sequencer state (as project snapshots) in the internal flash, so the last session can be
+ * restored at power up without the sd card. The flash region is used as a ring of records, each new session is
+ * written into the next record, which spreads the wear. A record is only valid once its header (written last)
+ * is complete and its crc matches, so an interrupted write leaves the previous session intact.
+ * The flash can not be erased / programmed in HSRUN mode (the teensy 3.6 above 120 MHz), the cpu is slowed down for
+ * the duration of each command. Programming is done in small steps by update(), so it can run while the sequencer is
+ * playing. Erasing a sector takes several ms, so the next record is erased in advance while the sequencer is stopped.
+ */
+class SessionStore {
+   public:
+    SessionStore(){};
+#ifdef SESSION_STORE_AVAILABLE
+    boolean isAvailable() { return !failed; }
+#else
+    boolean isAvailable() { return false; }
+#endif
+    // copies the newest valid session into snapshot. returns false if there is none.
+    bool restore(ProjectSnapshot &snapshot);
+    // starts writing the snapshot into the next record, which needs to be erased (see isPrepared()). the snapshot
+    // must not be changed until isStoring() returns false. crc is the crc32 of the snapshot.
+    bool startStore(const ProjectSnapshot &snapshot, uint32_t crc);
+    // continues storing (if any), or erases the next record if erasing is allowed. needs to be called once per loop.
+    void update(bool eraseAllowed);
+    // stops storing, the record stays invalid
+    void abort() { state = IDLE; }
+    boolean isStoring() { return state == PROGRAMMING || state == FINISHING; }
+    // true if the next record is erased and a session can be stored
+    boolean isPrepared() { return prepared; }
+    // crc of the session that was last stored or restored, 0 if none
+    uint32_t getStoredCrc() { return storedCrc; }
+
+   private:
+    enum State { IDLE, ERASING, PROGRAMMING, FINISHING };
+
+    // runs the next command, returns false if it failed
+    bool runNextCommand();
+    bool isValid(uint8_t record);
+
+    State state = IDLE;
+    bool prepared = false;
+    // set if a flash command failed, nothing is stored until the next power up
+    bool failed = false;
+    const uint8_t *source = NULL;
+    uint32_t sourceCrc = 0;
+    uint32_t storedCrc = 0;
+    uint32_t sequence = 1;
+    // the newest record
+    uint8_t record = 0;
+    // progress of the next record: erased sectors / programmed bytes
+    uint32_t position = 0;
+};
+
+#endif
@@ -45,15 +45,35 @@ class SimpleDrumChannel : public AudioChannel {
     void setParam1(int value) { drum.frequency(32.0f + value * 10.0f); }
     void setParam2(int value) { drum.pitchMod(value / 1024.0f); }
     void setParam3(int value) { drum.secondMix(value / 1024.0f); }
-    void setParam4(int value) { drum.length(value); }
+    void setParam4(int value) {
+        length = value;
+        updateLength();
+    }
     void setParam5(int value) { deelay.delay(0, value); }
     void setParam6(int value) { amp.gain(value / -1024.0f);}
 
+    void setQuality(uint8_t level) {
+        shortTails = level >= QUALITY_SHORT_TAILS;
+        updateLength();
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &drum, "drum");
+        profiler.add(track, &mixer, "mixer");
+        profiler.add(track, &deelay, "deelay");
+        profiler.add(track, &amp, "amp");
+    }
+
    private:
+    void updateLength() { drum.length(shortTails && length > QUALITY_SHORT_DECAY_MILLIS ? QUALITY_SHORT_DECAY_MILLIS : length); }
+
     int low = 35;
     int high = 880;
     int f1 = 100;
     int f2 = 0;
+    // param 4 (its default until it is set)
+    int length = 30;
+    bool shortTails = false;
     AudioSynthSimpleDrum drum;
     AudioMixer4 mixer;
     AudioEffectSimpleDelay deelay;
@@ -46,6 +46,10 @@ class SimpleSampleChannel : public AudioChannel {
     void setParam5(int value) {}
     void setParam6(int value) {}
 
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &sampler, "sampler");
+    }
+
    private:
     AudioPlayPitchedMemory sampler;
 };
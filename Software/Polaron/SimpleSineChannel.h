@@ -49,6 +49,15 @@ class SimpleSineChannel : public AudioChannel {
     void setParam5(int value) { envelope.retriggers(map(value, 0, 1024, 0, 12)); }
     void setParam6(int value) {}
 
+    void setQuality(uint8_t level) {
+        envelope.limit(getDecayLimit(level), getRetriggerLimit(level));
+    }
+
+    void addToProfile(AudioProfiler &profiler, uint8_t track) {
+        profiler.add(track, &osc, "osc");
+        profiler.add(track, &envelope, "envelope");
+    }
+
    private:
     int low = 35;
     int high = 880;
@@ -0,0 +1,55 @@
+#include "Trace.h"
+#include <SD.h>
+
+#ifdef TRACE
+Trace trace;
+#endif
+
+static void writeValue(Print &out, uint32_t value, uint8_t bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.write((uint8_t)(value >> (8 * i)));
+    }
+}
+
+void Trace::begin() {
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+void Trace::dump(Print &out) {
+    paused = true;
+    uint32_t total = count;
+    out.write((const uint8_t *)TRACE_MAGIC, 4);
+    writeValue(out, TRACE_VERSION, 1);
+    writeValue(out, sizeof(TraceRecord), 1);
+    writeValue(out, F_CPU, 4);
+    writeValue(out, total, 4);
+    uint32_t first = total > TRACE_SIZE ? total - TRACE_SIZE : 0;
+    writeValue(out, total - first, 4);
+    for (uint32_t i = first; i < total; i++) {
+        TraceRecord &record = records[i & (TRACE_SIZE - 1)];
+        writeValue(out, record.time, 4);
+        writeValue(out, (uint8_t)record.type, 1);
+        writeValue(out, record.arg, 1);
+        writeValue(out, record.value, 2);
+    }
+    paused = false;
+}
+
+bool Trace::dumpToFile() {
+    SD.remove(TRACE_FILE_NAME);
+    File file = SD.open(TRACE_FILE_NAME, FILE_WRITE);
+    if (!file) {
+        Serial.println(F("Failed to create trace file"));
+        return false;
+    }
+    dump(file);
+    file.close();
+    return true;
+}
+
+void TraceMarker::update(void) {
+#ifdef TRACE
+    trace.record(type, 0, 0);
+#endif
+}
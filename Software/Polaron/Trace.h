@@ -0,0 +1,128 @@
+#ifndef Trace_h
+#define Trace_h
+
+#include <Arduino.h>
+#include <AudioStream.h>
+
+// records timestamped events into a ring buffer (a few cycles per event). 't' over the serial port dumps the trace,
+// 'T' writes it to the sd card (while stopped). Software/Tools/trace_analyzer.py shows the timeline and the timing
+// statistics. takes 2KB of ram, comment out to not compile the recording in at all.
+#define TRACE
+
+// number of records kept, needs to be a power of 2
+#define TRACE_SIZE 256
+#define TRACE_FILE_NAME "TRACE.BIN"
+// start of a dump, followed by the version, the record size, the cpu frequency (the unit of the timestamps), the
+// number of records that were recorded in total and the number of records in the dump
+#define TRACE_MAGIC "PTRC"
+#define TRACE_VERSION 4
+
+// the type of a record, arg and value depend on it
+enum class TraceEvent : uint8_t {
+    NONE,
+    // arg: button (function buttons 0-7, track buttons 8-13, step buttons 14-29), value: 1 pressed, 0 released
+    BUTTON,
+    // a pulse at the trigger input (interrupt)
+    TRIGGER_INPUT,
+    // arg: the midi real time byte (clock, start, stop)
+    MIDI_REALTIME,
+    // the clock stepped. arg: ClockMode, value: step count
+    CLOCK,
+    // the sequencer stepped. arg: step index of the selected track, value: mask of the firing tracks
+    STEP,
+    // arg: the track whose channel is triggered
+    TRIGGER,
+    // arg: track, value: new pattern
+    PATTERN_SWITCH,
+    // an access to the sd card (or the flash) starts / ends. arg: TraceSdOp, value depends on the operation
+    SD_START,
+    SD_END,
+    // the audio library starts / finished updating all objects (audio interrupt)
+    AUDIO_START,
+    AUDIO_END,
+    // the cycle counter passed a quarter of its range (every ~6s at 180MHz), so records are never more than half a
+    // wrap apart. arg: the top two bits of the counter, value: number of wraps
+    TIME
+};
+
+enum class TraceSdOp : uint8_t { INIT, SAVE, PREFILL, LOAD, SESSION };
+
+class TraceRecord {
+   public:
+    // cycle counter
+    uint32_t time;
+    TraceEvent type;
+    uint8_t arg;
+    uint16_t value;
+};
+
+/*
+ * Ring buffer of the latest events. Events can be recorded from interrupts, the slot of a record is reserved
+ * atomically. Recording is paused while the trace is dumped.
+ */
+class Trace {
+   public:
+    Trace(){};
+    // enables the cycle counter
+    void begin();
+    // records a TIME event when the cycle counter passed a quarter of its range, needs to be called once per loop
+    void update() {
+        uint8_t quarter = ARM_DWT_CYCCNT >> 30;
+        if (quarter != lastQuarter) {
+            if (quarter < lastQuarter) {
+                wraps++;
+            }
+            lastQuarter = quarter;
+            record(TraceEvent::TIME, quarter, wraps);
+        }
+    }
+    void record(TraceEvent type, uint8_t arg, uint16_t value) {
+        if (paused) {
+            return;
+        }
+        uint32_t slot = __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+        TraceRecord &record = records[slot & (TRACE_SIZE - 1)];
+        record.time = ARM_DWT_CYCCNT;
+        record.type = type;
+        record.arg = arg;
+        record.value = value;
+    }
+    // writes the header and all records (oldest first) in binary, little endian
+    void dump(Print &out);
+    // writes the dump to TRACE_FILE_NAME, the sd card needs to be initialized
+    bool dumpToFile();
+
+   private:
+    TraceRecord records[TRACE_SIZE];
+    // number of records recorded since the start
+    uint32_t count = 0;
+    volatile bool paused = false;
+    uint8_t lastQuarter = 0;
+    uint16_t wraps = 0;
+};
+
+/*
+ * An audio object that only records an event when it is updated. As the audio library updates the objects in the
+ * order they were created, one marker created before all other objects and one after them mark the start and the
+ * end of each audio update.
+ */
+class TraceMarker : public AudioStream {
+   public:
+    TraceMarker(TraceEvent type) : AudioStream(0, NULL), type(type) {
+        // an object without connections is not updated otherwise
+        active = true;
+    }
+    virtual void update(void);
+
+   private:
+    TraceEvent type;
+};
+
+#ifdef TRACE
+extern Trace trace;
+#define TRACE_EVENT(type, arg, value) trace.record(TraceEvent::type, (uint8_t)(arg), (uint16_t)(value))
+#else
+#define TRACE_EVENT(type, arg, value)
+#endif
+
+#endif
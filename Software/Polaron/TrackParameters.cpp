@@ -0,0 +1,49 @@
+#include "TrackParameters.h"
+#include <string.h>
+
+void TrackParameters::clear() {
+    base = 0;
+    memset(values, 0, sizeof(values));
+    memset(masks, 0, sizeof(masks));
+    memset(refCounts, 0, sizeof(refCounts));
+    full = false;
+}
+
+LockIndex TrackParameters::create(uint8_t mask, PackedParameterSet lockValues) {
+    if (mask == 0) {
+        return NO_PARAMETER_LOCK;
+    }
+    for (LockIndex i = 0; i < PARAMETER_LOCKS_PER_TRACK; i++) {
+        if (masks[i] == 0) {
+            masks[i] = mask;
+            values[i] = lockValues;
+            refCounts[i] = 1;
+            return i;
+        }
+    }
+    full = true;
+    return NO_PARAMETER_LOCK;
+}
+
+bool TrackParameters::set(LockIndex &lock, uint8_t parameter, uint16_t value) {
+    if (lock == NO_PARAMETER_LOCK) {
+        LockIndex created = create(1 << parameter, setPackedParameter(0, parameter, value));
+        if (created == NO_PARAMETER_LOCK) {
+            return false;
+        }
+        lock = created;
+        return true;
+    }
+    if (refCounts[lock] > 1) {
+        // other blocks keep the values of the shared lock
+        LockIndex copy = duplicate(lock);
+        if (copy == NO_PARAMETER_LOCK) {
+            return false;
+        }
+        release(lock);
+        lock = copy;
+    }
+    masks[lock] |= 1 << parameter;
+    values[lock] = setPackedParameter(values[lock], parameter, value);
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef TrackParameters_h
+#define TrackParameters_h
+
+#include <inttypes.h>
+#include "SequencerConfig.h"
+#include "ParameterSet.h"
+
+// number of locks a track can hold. enough for every step of a legacy project (16 patterns of 16 steps), which has
+// the parameters of every step, so converting one always fits.
+#define PARAMETER_LOCKS_PER_TRACK 256
+// index of a lock in the pool of a track
+typedef BitMask<bitsFor(PARAMETER_LOCKS_PER_TRACK)>::type LockIndex;
+// lock index of a step without parameter locks
+#define NO_PARAMETER_LOCK PARAMETER_LOCKS_PER_TRACK
+
+/*
+ * The sound parameters of a track: a base set, which the pots change live, and the parameter locks of the steps.
+ * A lock overrides some of the base parameters (the ones in its mask), the rest follow the base set. Only locked
+ * steps use memory here, all patterns of the track share the pool of locks. Steps refer to a lock by its index.
+ * Blocks of step data that are copies of each other (copy on write, see StepDataPool) share their locks, a lock
+ * counts the blocks that refer to it. A block refers to a lock with one step at most.
+ */
+class TrackParameters {
+   public:
+    TrackParameters() { clear(); };
+    // releases all locks
+    void clear();
+    // returns the parameters of a step with the given lock (the base set for NO_PARAMETER_LOCK)
+    PackedParameterSet get(LockIndex lock) {
+        if (lock == NO_PARAMETER_LOCK) {
+            return base;
+        }
+        PackedParameterSet locked = parameterFieldMask(masks[lock]);
+        return (base & ~locked) | (values[lock] & locked);
+    }
+    // returns a new lock with the given values, NO_PARAMETER_LOCK if mask is 0 or all locks are in use
+    LockIndex create(uint8_t mask, PackedParameterSet lockValues);
+    // locks one parameter (0..5) to value. a new lock is allocated if lock is NO_PARAMETER_LOCK or shared with other
+    // blocks. returns false (and leaves lock unchanged) if there is no free lock left.
+    bool set(LockIndex &lock, uint8_t parameter, uint16_t value);
+    // returns a new lock with the same values, NO_PARAMETER_LOCK if lock is NO_PARAMETER_LOCK or if there is no free lock
+    LockIndex duplicate(LockIndex lock) { return lock == NO_PARAMETER_LOCK ? NO_PARAMETER_LOCK : create(masks[lock], values[lock]); }
+    // another block refers to the lock
+    void retain(LockIndex lock) {
+        if (lock != NO_PARAMETER_LOCK) {
+            refCounts[lock]++;
+        }
+    }
+    // a block does not refer to the lock anymore, the lock is free when no block refers to it
+    void release(LockIndex lock) {
+        if (lock != NO_PARAMETER_LOCK && --refCounts[lock] == 0) {
+            masks[lock] = 0;
+        }
+    }
+    // returns which parameters are locked (bit n for parameter n)
+    uint8_t getMask(LockIndex lock) { return lock == NO_PARAMETER_LOCK ? 0 : masks[lock]; }
+    // returns true if a lock could not be created since the last call (the edit that needed it was not done)
+    bool checkFull() {
+        bool wasFull = full;
+        full = false;
+        return wasFull;
+    }
+
+    PackedParameterSet base;
+    // values of the locks, only the parameters in the mask of a lock are used
+    PackedParameterSet values[PARAMETER_LOCKS_PER_TRACK];
+    // a lock with mask 0 is free
+    uint8_t masks[PARAMETER_LOCKS_PER_TRACK];
+    // number of blocks of step data that refer to each lock
+    uint8_t refCounts[PARAMETER_LOCKS_PER_TRACK];
+    // create() failed
+    bool full;
+};
+
+#endif
@@ -86,18 +86,30 @@ class AudioEffectShapedEnvelope : public AudioStream {
 
     void decay(int samples) {
         if (samples > 0 && samples < 65535) {
-            decay_count = samples;
+            decay_request = samples;
         } else {
-            decay_count = 1;
+            decay_request = 1;
         }
+        applyLimits();
     }
 
     void retriggers(int count) {
         if (count >= 0 && count < 256) {
-            maxRetriggers = count;
+            retrigger_request = count;
         } else {
-            maxRetriggers = 0;
+            retrigger_request = 0;
         }
+        applyLimits();
+    }
+
+    /*
+    * caps the decay (in samples) and the number of retriggers, to reduce the load (see AudioGovernor).
+    * the values set by decay() / retriggers() apply again once the limits are raised.
+    */
+    void limit(uint16_t maxDecay, uint16_t maxRetriggerCount) {
+        decay_limit = maxDecay > 0 ? maxDecay : 1;
+        retrigger_limit = maxRetriggerCount;
+        applyLimits();
     }
 
     using AudioStream::release;
@@ -119,6 +131,11 @@ class AudioEffectShapedEnvelope : public AudioStream {
     uint16_t attack_count;
     uint16_t hold_count;
     uint16_t decay_count;
+    // the values that were set, before the limits
+    uint16_t decay_request = 1;
+    uint16_t retrigger_request = 0;
+    uint16_t decay_limit = 65535;
+    uint16_t retrigger_limit = 65535;
 
     uint32_t phase_accumulator = 0;
     uint32_t phase_increment = 0;
@@ -131,6 +148,11 @@ class AudioEffectShapedEnvelope : public AudioStream {
     float lt_mult = 0.0f;
     float lt_add = 0.0f;
 
+    void applyLimits() {
+        decay_count = decay_request < decay_limit ? decay_request : decay_limit;
+        maxRetriggers = retrigger_request < retrigger_limit ? retrigger_request : retrigger_limit;
+    }
+
     // calculates a linear transfrom to be used to map the values from the
     // lookup table to the desired start/end values of the envelope (eg. map
     // values 0-32767 to 10000-0 for a decay)
@@ -26,6 +26,7 @@
 
 #include <Arduino.h>
 #include "effect_simple_delay.h"
+#include "AudioPool.h"
 
 void AudioEffectSimpleDelay::update(void)
 {
@@ -37,10 +38,10 @@ void AudioEffectSimpleDelay::update(void)
 	// grab incoming data and put it into the queue
 	head = headindex;
 	tail = tailindex;
-	if (++head >= DELAY_QUEUE_SIZE) head = 0;
+	if (++head >= queueSize) head = 0;
 	if (head == tail) {
 		if (queue[tail] != NULL) release(queue[tail]);
-		if (++tail >= DELAY_QUEUE_SIZE) tail = 0;
+		if (++tail >= queueSize) tail = 0;
 	}
 	queue[head] = receiveReadOnly();
 	headindex = head;
@@ -66,7 +67,7 @@ void AudioEffectSimpleDelay::update(void)
 	if (head >= tail) {
 		count = head - tail;
 	} else {
-		count = DELAY_QUEUE_SIZE + head - tail;
+		count = queueSize + head - tail;
 	}
 	if (count > maxblocks) {
 		count -= maxblocks;
@@ -75,7 +76,7 @@ void AudioEffectSimpleDelay::update(void)
 				release(queue[tail]);
 				queue[tail] = NULL;
 			}
-			if (++tail >= DELAY_QUEUE_SIZE) tail = 0;
+			if (++tail >= queueSize) tail = 0;
 		} while (--count > 0);
 	}
 	tailindex = tail;
@@ -88,7 +89,7 @@ void AudioEffectSimpleDelay::update(void)
 		if (head >= index) {
 			index = head - index;
 		} else {
-			index = DELAY_QUEUE_SIZE + head - index;
+			index = queueSize + head - index;
 		}
 		if (offset == 0) {
 			// delay falls on the block boundary
@@ -98,12 +99,15 @@ void AudioEffectSimpleDelay::update(void)
 		} else {
 			// delay requires grabbing data from 2 blocks
 			output = allocate();
-			if (!output) continue;
+			if (!output) {
+				AudioPool::countFailure();
+				continue;
+			}
 			dst = output->data;
 			if (index > 0) {
 				prev = index - 1;
 			} else {
-				prev = DELAY_QUEUE_SIZE-1;
+				prev = queueSize-1;
 			}
 			if (queue[prev]) {
 				end = queue[prev]->data + AUDIO_BLOCK_SAMPLES;
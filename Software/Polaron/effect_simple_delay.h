@@ -25,25 +25,18 @@
  */
 
 // a modified version of the stock teensy delay. does not reduce maxblocks when the delay is changed on an existing channel (-> caused clicks)
+// the queue only holds the blocks needed for SIMPLE_DELAY_MAX_SAMPLES (the stock delay reserves 2.41 seconds,
+// which grows with smaller audio blocks: 6656 pointers with 16 samples per block)
 #ifndef effect_simple_delay_h_
 #define effect_simple_delay_h_
 #include "Arduino.h"
 #include "AudioStream.h"
 #include "utility/dspinst.h"
 
-#if defined(__MK66FX1M0__)
-  // 2.41 second maximum on Teensy 3.6
-  #define DELAY_QUEUE_SIZE  (106496 / AUDIO_BLOCK_SAMPLES)
-#elif defined(__MK64FX512__)
-  // 1.67 second maximum on Teensy 3.5
-  #define DELAY_QUEUE_SIZE  (73728 / AUDIO_BLOCK_SAMPLES)
-#elif defined(__MK20DX256__)
-  // 0.45 second maximum on Teensy 3.1 & 3.2
-  #define DELAY_QUEUE_SIZE  (19826 / AUDIO_BLOCK_SAMPLES)
-#else
-  // 0.14 second maximum on Teensy 3.0
-  #define DELAY_QUEUE_SIZE  (6144 / AUDIO_BLOCK_SAMPLES)
-#endif
+// the longest delay of all channels (SimpleDrumChannel), longer ones are shortened to it
+#define SIMPLE_DELAY_MAX_SAMPLES 1024
+// the newest block, the blocks of the longest delay and one more for its partial block
+#define DELAY_QUEUE_SIZE  ((SIMPLE_DELAY_MAX_SAMPLES + AUDIO_BLOCK_SAMPLES - 1) / AUDIO_BLOCK_SAMPLES + 2)
 
 class AudioEffectSimpleDelay : public AudioStream
 {
@@ -53,13 +46,16 @@ public:
 		headindex = 0;
 		tailindex = 0;
 		maxblocks = 0;
+
 		memset(queue, 0, sizeof(queue));
 
-		uint32_t nmax = AUDIO_BLOCK_SAMPLES * (DELAY_QUEUE_SIZE-1);
+		uint32_t nmax = SIMPLE_DELAY_MAX_SAMPLES;
         if (maximumNumberOfSamples < 0) maximumNumberOfSamples = 0;
         if (maximumNumberOfSamples > nmax) maximumNumberOfSamples = nmax;
 		maxblocks = (maximumNumberOfSamples + (AUDIO_BLOCK_SAMPLES-1)) / AUDIO_BLOCK_SAMPLES + 1;
         maxSamples = maximumNumberOfSamples;
+        // the newest block plus maxblocks older ones
+        queueSize = maxblocks + 1;
 	}
 
 	void delay(uint8_t channel, uint32_t samples) {
@@ -88,6 +84,7 @@ private:
 	uint16_t headindex;    // head index (incoming) data in quueu
 	uint16_t tailindex;    // tail index (outgoing) data from queue
 	uint16_t maxblocks;    // number of blocks needed in queue
+	uint16_t queueSize;
 #if DELAY_QUEUE_SIZE * AUDIO_BLOCK_SAMPLES < 65535
 	uint16_t position[8]; // # of sample delay for each channel
 #else
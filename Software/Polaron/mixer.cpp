@@ -28,6 +28,9 @@
 #include "mixer.h"
 #include "utility/dspinst.h"
 
+// the samples are processed in pairs (one 32 bit word)
+static_assert(AUDIO_BLOCK_SAMPLES % 2 == 0, "the mixer needs an even number of samples per block");
+
 void applyGain(int16_t *data, int32_t mult) {
     uint32_t *p = (uint32_t *)data;
     const uint32_t *end = (uint32_t *)(data + AUDIO_BLOCK_SAMPLES);
@@ -42,54 +45,87 @@ void applyGain(int16_t *data, int32_t mult) {
     } while (p < end);
 }
 
-// page 133
-
-void applyGainThenAdd(int16_t *data, const int16_t *in, int32_t mult) {
-    uint32_t *dst = (uint32_t *)data;
-    const uint32_t *src = (uint32_t *)in;
-    const uint32_t *end = (uint32_t *)(data + AUDIO_BLOCK_SAMPLES);
+// the inputs are summed with 32 bits, so only the final sum is saturated (and not every partial sum)
+// sum = data * mult
+void applyGainToSum(int32_t *sum, const int16_t *data, int32_t mult) {
+    const uint32_t *src = (const uint32_t *)data;
+    const uint32_t *end = (const uint32_t *)(data + AUDIO_BLOCK_SAMPLES);
 
     if (mult == 65536) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            sum[i] = data[i];
+        }
+    } else {
         do {
-            uint32_t tmp32 = *dst;
-            *dst++ = signed_add_16_and_16(tmp32, *src++);
-            tmp32 = *dst;
-            *dst++ = signed_add_16_and_16(tmp32, *src++);
-        } while (dst < end);
+            uint32_t tmp32 = *src++;  // read 2 samples from *data
+            *sum++ = signed_multiply_32x16b(mult, tmp32);
+            *sum++ = signed_multiply_32x16t(mult, tmp32);
+        } while (src < end);
+    }
+}
+
+// sum += data * mult
+void applyGainThenAddToSum(int32_t *sum, const int16_t *data, int32_t mult) {
+    const uint32_t *src = (const uint32_t *)data;
+    const uint32_t *end = (const uint32_t *)(data + AUDIO_BLOCK_SAMPLES);
+
+    if (mult == 65536) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+            sum[i] += data[i];
+        }
     } else {
         do {
             uint32_t tmp32 = *src++;  // read 2 samples from *data
-            int32_t val1 = signed_multiply_32x16b(mult, tmp32);
-            int32_t val2 = signed_multiply_32x16t(mult, tmp32);
-            val1 = signed_saturate_rshift(val1, 16, 0);
-            val2 = signed_saturate_rshift(val2, 16, 0);
-            tmp32 = pack_16b_16b(val2, val1);
-            uint32_t tmp32b = *dst;
-            *dst++ = signed_add_16_and_16(tmp32, tmp32b);
-        } while (dst < end);
+            sum[0] = signed_multiply_accumulate_32x16b(sum[0], mult, tmp32);
+            sum[1] = signed_multiply_accumulate_32x16t(sum[1], mult, tmp32);
+            sum += 2;
+        } while (src < end);
     }
 }
 
+void saturateSum(int16_t *data, const int32_t *sum) {
+    uint32_t *dst = (uint32_t *)data;
+    const uint32_t *end = (uint32_t *)(data + AUDIO_BLOCK_SAMPLES);
+
+    do {
+        int32_t val1 = signed_saturate_rshift(*sum++, 16, 0);
+        int32_t val2 = signed_saturate_rshift(*sum++, 16, 0);
+        *dst++ = pack_16b_16b(val2, val1);
+    } while (dst < end);
+}
+
 void AudioMixer8::update(void) {
     audio_block_t *in, *out = NULL;
     unsigned int channel;
+    unsigned int first = 0;
+    bool summing = false;
+    // static: too large for the stack of the audio interrupt (the mixers are updated one after another)
+    static int32_t sum[AUDIO_BLOCK_SAMPLES];
 
     for (channel = 0; channel < 8; channel++) {
         if (!out) {
+            // the first input is also used for the output
             out = receiveWritable(channel);
-            if (out) {
-                int32_t mult = multiplier[channel];
-                if (mult != 65536) applyGain(out->data, mult);
-            }
+            first = channel;
         } else {
             in = receiveReadOnly(channel);
             if (in) {
-                applyGainThenAdd(out->data, in->data, multiplier[channel]);
+                if (!summing) {
+                    applyGainToSum(sum, out->data, multiplier[first]);
+                    summing = true;
+                }
+                applyGainThenAddToSum(sum, in->data, multiplier[channel]);
                 release(in);
             }
         }
     }
     if (out) {
+        if (summing) {
+            saturateSum(out->data, sum);
+        } else if (multiplier[first] != 65536) {
+            // only one input
+            applyGain(out->data, multiplier[first]);
+        }
         transmit(out);
         release(out);
     }
@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""
+Reads a trace dumped by the sequencer (see Software/Polaron/Trace.h) and prints the timeline and timing statistics.
+
+The trace is read from a file: TRACE.BIN from the sd card, or a capture of the serial port after sending 't'
+(anything before the start of the dump is skipped). With --port, the dump is requested from the device directly
+(needs pyserial).
+
+usage: trace_analyzer.py [--timeline] [--port PORT] [file]
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"PTRC"
+VERSION = 4
+
+EVENTS = ["none", "button", "trigger input", "midi realtime", "clock", "step", "trigger", "pattern switch",
+          "sd start", "sd end", "audio start", "audio end", "time"]
+(NONE, BUTTON, TRIGGER_INPUT, MIDI_REALTIME, CLOCK, STEP, TRIGGER, PATTERN_SWITCH,
+ SD_START, SD_END, AUDIO_START, AUDIO_END, TIME) = range(len(EVENTS))
+SD_OPS = ["init", "save", "prefill", "load", "session"]
+CLOCK_MODES = ["internal", "midi", "trigger"]
+MIDI_CLOCK = 0xF8
+FUNCTION_BUTTONS = 8
+TRACK_BUTTONS = 6
+
+
+class Record:
+    def __init__(self, time, event, arg, value):
+        # micros since the first record
+        self.time = time
+        self.event = event
+        self.arg = arg
+        self.value = value
+
+
+def read_dump(data):
+    start = data.find(MAGIC)
+    if start < 0:
+        raise ValueError("no trace found")
+    version, record_size, cpu_frequency, total, count = struct.unpack_from("<BBIII", data, start + 4)
+    if version != VERSION or record_size != 8:
+        raise ValueError("unsupported trace version %d" % version)
+    # a serial capture goes on after the dump
+    if (len(data) - start - 18) // record_size < count:
+        raise ValueError("the trace is cut off")
+    records = []
+    previous = None
+    offset = 0
+    for i in range(count):
+        cycles, event, arg, value = struct.unpack_from("<IBBH", data, start + 18 + i * record_size)
+        # the cycle counter wraps around every 2^32 cycles. the sequencer records a time event every quarter wrap, so
+        # records are less than half a wrap apart. records from interrupts can be a few cycles older than the record
+        # before them, only a big step back is a wrap.
+        if previous is not None and cycles < previous and previous - cycles > 1 << 31:
+            offset += 1 << 32
+        elif previous is not None and cycles > previous and cycles - previous > 1 << 31:
+            offset -= 1 << 32
+        previous = cycles
+        records.append(Record(cycles + offset, event, arg, value))
+    if records:
+        first = min(r.time for r in records)
+        for r in records:
+            r.time = (r.time - first) * 1e6 / cpu_frequency
+    return records, total
+
+
+def request_dump(port):
+    import serial
+    import time
+    with serial.Serial(port, timeout=1) as connection:
+        connection.reset_input_buffer()
+        connection.write(b"t")
+        time.sleep(0.5)
+        data = b""
+        while True:
+            chunk = connection.read(4096)
+            if not chunk:
+                return data
+            data += chunk
+
+
+def describe(r):
+    if r.event == BUTTON:
+        if r.arg < FUNCTION_BUTTONS:
+            button = "function %d" % (r.arg + 1)
+        elif r.arg < FUNCTION_BUTTONS + TRACK_BUTTONS:
+            button = "track %d" % (r.arg - FUNCTION_BUTTONS + 1)
+        else:
+            button = "step %d" % (r.arg - FUNCTION_BUTTONS - TRACK_BUTTONS + 1)
+        return "%s %s" % (button, "pressed" if r.value else "released")
+    if r.event == MIDI_REALTIME:
+        return "0x%02X" % r.arg
+    if r.event == CLOCK:
+        mode = CLOCK_MODES[r.arg] if r.arg < len(CLOCK_MODES) else str(r.arg)
+        return "%s, step count %d" % (mode, r.value)
+    if r.event == STEP:
+        return "step %d, firing tracks %s" % (r.arg + 1, format(r.value, "06b")[::-1])
+    if r.event == TRIGGER:
+        return "track %d" % (r.arg + 1)
+    if r.event == PATTERN_SWITCH:
+        return "track %d, pattern %d" % (r.arg + 1, r.value + 1)
+    if r.event == TIME:
+        return "wrap %d, quarter %d" % (r.value, r.arg + 1)
+    if r.event in (SD_START, SD_END):
+        op = SD_OPS[r.arg] if r.arg < len(SD_OPS) else str(r.arg)
+        return "%s (%d)" % (op, r.value)
+    return ""
+
+
+def print_timeline(records):
+    previous = None
+    for r in records:
+        delta = r.time - previous if previous is not None else 0
+        previous = r.time
+        name = EVENTS[r.event] if r.event < len(EVENTS) else "unknown %d" % r.event
+        print("%12.1f %+10.1f  %-15s %s" % (r.time, delta, name, describe(r)))
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(len(ordered) * p / 100))]
+
+
+def print_stats(name, values):
+    if not values:
+        return
+    mean = sum(values) / len(values)
+    deviation = (sum((v - mean) ** 2 for v in values) / len(values)) ** 0.5
+    print("%-34s n=%-6d mean=%9.1f  sd=%8.1f  min=%9.1f  p50=%9.1f  p99=%9.1f  max=%9.1f" % (
+        name, len(values), mean, deviation, min(values), percentile(values, 50), percentile(values, 99), max(values)))
+
+
+def intervals(times):
+    return [b - a for a, b in zip(times, times[1:])]
+
+
+def jitter(times):
+    # deviation of each interval from the median interval
+    values = intervals(times)
+    if not values:
+        return []
+    median = percentile(values, 50)
+    return [abs(v - median) for v in values]
+
+
+def latencies(causes, effects, limit):
+    # time from each cause to the first effect after it (if within limit)
+    result = []
+    j = 0
+    for cause in causes:
+        while j < len(effects) and effects[j] < cause:
+            j += 1
+        if j < len(effects) and effects[j] - cause <= limit:
+            result.append(effects[j] - cause)
+    return result
+
+
+def durations(records, start_event, end_event, key):
+    # matches start and end records with the same key
+    started = {}
+    result = {}
+    for r in records:
+        if r.event == start_event:
+            started[key(r)] = r.time
+        elif r.event == end_event and key(r) in started:
+            result.setdefault(key(r), []).append(r.time - started.pop(key(r)))
+    return result
+
+
+def print_analysis(records, total):
+    lost = total - len(records)
+    print("%d records, %.1f ms%s" % (len(records), records[-1].time / 1000 if records else 0,
+                                     ", %d older records were overwritten" % lost if lost > 0 else ""))
+    print("all times in micros\n")
+    times = {}
+    for r in records:
+        times.setdefault(r.event, []).append(r.time)
+    clocks = times.get(CLOCK, [])
+    steps = times.get(STEP, [])
+    audio = times.get(AUDIO_START, [])
+    midi_clocks = [r.time for r in records if r.event == MIDI_REALTIME and r.arg == MIDI_CLOCK]
+
+    print_stats("clock interval", intervals(clocks))
+    print_stats("clock jitter", jitter(clocks))
+    print_stats("midi clock interval", intervals(midi_clocks))
+    print_stats("midi clock jitter", jitter(midi_clocks))
+    print_stats("trigger input interval", intervals(times.get(TRIGGER_INPUT, [])))
+    print_stats("trigger input -> clock", latencies(times.get(TRIGGER_INPUT, []), clocks, 100000))
+    print_stats("midi clock -> clock", latencies(midi_clocks, clocks, 100000))
+    print_stats("clock -> step", latencies(clocks, steps, 100000))
+    print_stats("step -> first trigger", latencies(steps, times.get(TRIGGER, []), 10000))
+    # a triggered sound is computed by the next audio update
+    print_stats("trigger -> audio update", latencies(times.get(TRIGGER, []), audio, 100000))
+    print_stats("button press -> step", latencies(
+        [r.time for r in records if r.event == BUTTON and r.value], steps, 1000000))
+    print_stats("audio update interval", intervals(audio))
+    print_stats("audio update jitter", jitter(audio))
+    for key, values in sorted(durations(records, AUDIO_START, AUDIO_END, lambda r: 0).items()):
+        print_stats("audio update duration", values)
+    for op, values in sorted(durations(records, SD_START, SD_END, lambda r: r.arg).items()):
+        print_stats("sd %s duration" % (SD_OPS[op] if op < len(SD_OPS) else op), values)
+
+    # steps that came late while the sd card was busy
+    if len(clocks) > 2:
+        median = percentile(intervals(clocks), 50)
+        busy = []
+        for r in records:
+            if r.event == SD_START:
+                busy.append([r.time, None])
+            elif r.event == SD_END and busy and busy[-1][1] is None:
+                busy[-1][1] = r.time
+        late = 0
+        late_during_sd = 0
+        for a, b in zip(clocks, clocks[1:]):
+            if b - a > median * 1.1:
+                late += 1
+                if any(start < b and (end is None or end > a) for start, end in busy):
+                    late_during_sd += 1
+        print("\n%d of %d clock intervals more than 10%% longer than the median, %d of them overlap an sd access" % (
+            late, len(clocks) - 1, late_during_sd))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="analyzes a trace of the sequencer")
+    parser.add_argument("file", nargs="?", help="dump from the sd card or a serial capture")
+    parser.add_argument("--port", help="request the dump from the serial port")
+    parser.add_argument("--timeline", action="store_true", help="print all records")
+    args = parser.parse_args()
+    if args.port:
+        data = request_dump(args.port)
+    elif args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        parser.error("a file or a port is needed")
+    try:
+        records, total = read_dump(data)
+    except ValueError as e:
+        sys.exit(str(e))
+    if args.timeline:
+        print_timeline(records)
+        print()
+    print_analysis(records, total)
+
+
+if __name__ == "__main__":
+    main()